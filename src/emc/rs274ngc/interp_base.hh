@@ -67,6 +67,10 @@ public:
     virtual void print_state_tag(StateTag const &tag) = 0;
     virtual void set_loglevel(int level) = 0;
     virtual void set_loop_on_main_m99(bool state) = 0;
+    // optional run-from-line checkpoints; interpreters without
+    // support never write any and always resume from the start
+    virtual int checkpoint(bool begin) { return 0; }
+    virtual int restore_checkpoint(int line) { return 0; }
     FILE* get_stdout() { return stdout; };
 };
 
@@ -0,0 +1,451 @@
+/********************************************************************
+* Description: interp_checkpoint.cc
+*
+* Run-from-line checkpoints.
+*
+* Starting a program in the middle means interpreting every line before
+* the start line and throwing the resulting motion away.  With
+* [RS274NGC]CHECKPOINT_INTERVAL set, a pass over the program that starts
+* at line 0 appends the interpreter state every N lines to a sidecar file
+* next to the program (foo.ngc -> foo.ngc.ckpt).  A later run from line L
+* restores the last checkpoint before L and only interprets the remaining
+* lines.
+*
+* A checkpoint holds:
+*   - the modal G/M codes and F/S/G64 settings, replayed as G-code like M72
+*   - the motion mode and canned cycle words
+*   - the numbered parameters the program changed since the start of the pass
+*   - the global named parameters
+*   - the o-word label table and the file offset of the next line
+*
+* Checkpoints are only taken at call level 0 outside of remaps, sub
+* definitions and cutter compensation.  Parameters not changed by the
+* program keep their current values, so touching off again after a
+* tool break is honored.  The sidecar is tied to the size and mtime of
+* the program and ignored once the program changes.
+*
+* License: GPL Version 2
+* System: Linux
+*
+********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include "rs274ngc.hh"
+#include "rs274ngc_return.hh"
+#include "rs274ngc_interp.hh"
+#include "interp_internal.hh"
+#include "interp_parameter_def.hh"
+#include <rtapi_string.h>
+
+#define CHECKPOINT_MAGIC "LINUXCNC-CHECKPOINTS"
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_SUFFIX ".ckpt"
+
+// parameters owned by synch() or recomputed on every read
+static bool checkpoint_param_skipped(int n)
+{
+    return (n >= 5400 && n <= 5413)	// current tool
+	|| (n >= 5420 && n <= 5428)	// current position
+	|| n == 5600 || n == 5601;	// toolchanger fault/reason
+}
+
+static int checkpoint_header(FILE *fp, const char *program)
+{
+    struct stat st;
+    if (stat(program, &st) != 0)
+	return -1;
+    fprintf(fp, "%s %d %lld %lld\n", CHECKPOINT_MAGIC, CHECKPOINT_VERSION,
+	    (long long) st.st_size, (long long) st.st_mtime);
+    return 0;
+}
+
+static bool checkpoint_header_ok(FILE *fp, const char *program)
+{
+    struct stat st;
+    char magic[32];
+    int version;
+    long long size, mtime;
+
+    if (stat(program, &st) != 0)
+	return false;
+    if (fscanf(fp, "%31s %d %lld %lld\n", magic, &version, &size, &mtime) != 4)
+	return false;
+    return !strcmp(magic, CHECKPOINT_MAGIC) &&
+	version == CHECKPOINT_VERSION &&
+	size == (long long) st.st_size &&
+	mtime == (long long) st.st_mtime;
+}
+
+// last line covered by an existing, still valid sidecar
+static int checkpoint_last_line(const char *sidecar, const char *program)
+{
+    char buf[LINELEN + PATH_MAX];
+    int line, last = 0;
+    FILE *fp = fopen(sidecar, "r");
+
+    if (!fp)
+	return 0;
+    if (checkpoint_header_ok(fp, program)) {
+	while (fgets(buf, sizeof(buf), fp)) {
+	    if (sscanf(buf, "CHECKPOINT %d", &line) == 1 && line > last)
+		last = line;
+	}
+    }
+    fclose(fp);
+    return last;
+}
+
+bool Interp::checkpoint_allowed(setup_pointer settings)
+{
+    return settings->call_level == 0 &&
+	settings->remap_level == 0 &&
+	!settings->defining_sub &&
+	!settings->skipping_o &&
+	!settings->skipping_to_sub &&
+	settings->cutter_comp_side == CUTTER_COMP::OFF &&
+	!settings->toolchange_flag &&
+	!settings->probe_flag &&
+	!settings->input_flag &&
+	settings->file_pointer != NULL;
+}
+
+/*! Interp::checkpoint
+
+Returned Value: int (INTERP_OK)
+
+Called by task with begin set when a run starts at the top of the
+program, and without after every line executed in AUTO mode.  Later
+calls append a checkpoint to a temporary sidecar every
+CHECKPOINT_INTERVAL lines.  Failing to write the sidecar only disables
+checkpoints for the rest of the pass.
+*/
+int Interp::checkpoint(bool begin)
+{
+    FORCE_LC_NUMERIC_C;
+    int n;
+
+    if (_setup.checkpoint_interval <= 0 || _setup.file_pointer == NULL)
+	return INTERP_OK;
+
+    if (begin) {
+	checkpoint_close(&_setup);
+	_setup.checkpoint_base.assign(_setup.parameters,
+	    _setup.parameters + interp_param_global::RS274NGC_MAX_PARAMETERS);
+	_setup.checkpoint_line = 0;
+	snprintf(_setup.checkpoint_file, sizeof(_setup.checkpoint_file),
+		 "%s" CHECKPOINT_SUFFIX, _setup.filename);
+	return INTERP_OK;
+    }
+
+    // passes which did not start at line 0 are never recorded
+    if (_setup.checkpoint_base.empty())
+	return INTERP_OK;
+    if (_setup.sequence_number < _setup.checkpoint_line + _setup.checkpoint_interval)
+	return INTERP_OK;
+    if (!checkpoint_allowed(&_setup))
+	return INTERP_OK;
+
+    if (_setup.checkpoint_fp == NULL) {
+	std::string tmp = std::string(_setup.checkpoint_file) + ".tmp";
+	_setup.checkpoint_prev_line =
+	    checkpoint_last_line(_setup.checkpoint_file, _setup.filename);
+	_setup.checkpoint_fp = fopen(tmp.c_str(), "w");
+	if (_setup.checkpoint_fp == NULL ||
+	    checkpoint_header(_setup.checkpoint_fp, _setup.filename) != 0) {
+	    logDebug("checkpoint: cannot write '%s', disabled for this run",
+		     tmp.c_str());
+	    checkpoint_close(&_setup);
+	    return INTERP_OK;
+	}
+    }
+
+    FILE *fp = _setup.checkpoint_fp;
+
+    write_g_codes((block_pointer) NULL, &_setup);
+    write_m_codes((block_pointer) NULL, &_setup);
+    write_settings(&_setup);
+
+    fprintf(fp, "CHECKPOINT %d %ld %d\n", _setup.sequence_number,
+	    ftell(_setup.file_pointer), _setup.executed_if);
+    fprintf(fp, "G");
+    for (n = 0; n < ACTIVE_G_CODES; n++)
+	fprintf(fp, " %d", _setup.active_g_codes[n]);
+    fprintf(fp, "\nM");
+    for (n = 0; n < ACTIVE_M_CODES; n++)
+	fprintf(fp, " %d", _setup.active_m_codes[n]);
+    fprintf(fp, "\nS");
+    for (n = 0; n < ACTIVE_SETTINGS; n++)
+	fprintf(fp, " %.17g", _setup.active_settings[n]);
+    fprintf(fp, "\nC %d %d %.17g %.17g %.17g %.17g %.17g %.17g %d %.17g\n",
+	    _setup.motion_mode, _setup.cycle_l,
+	    _setup.cycle_i, _setup.cycle_j, _setup.cycle_k,
+	    _setup.cycle_p, _setup.cycle_q, _setup.cycle_r,
+	    _setup.cycle_il_flag, _setup.cycle_il);
+
+    for (n = 1; n < interp_param_global::RS274NGC_MAX_PARAMETERS; n++) {
+	if (checkpoint_param_skipped(n) ||
+	    _setup.parameters[n] == _setup.checkpoint_base[n])
+	    continue;
+	fprintf(fp, "P %d %.17g\n", n, _setup.parameters[n]);
+    }
+
+    parameter_map &globals = _setup.sub_context[0].named_params;
+    for (parameter_map_iterator pi = globals.begin(); pi != globals.end(); pi++) {
+	if (pi->second.attr & (PA_READONLY | PA_UNSET | PA_USE_LOOKUP |
+			       PA_FROM_INI | PA_PYTHON))
+	    continue;
+	fprintf(fp, "N %.17g %s\n", pi->second.value, pi->first);
+    }
+
+    for (offset_map_iterator oi = _setup.offset_map.begin();
+	 oi != _setup.offset_map.end(); oi++) {
+	fprintf(fp, "O %d %ld %d %d %s %s\n", oi->second.type,
+		oi->second.offset, oi->second.sequence_number,
+		oi->second.repeat_count, oi->first, oi->second.filename);
+    }
+    fprintf(fp, "END\n");
+    fflush(fp);
+
+    _setup.checkpoint_line = _setup.sequence_number;
+    return INTERP_OK;
+}
+
+/*! Interp::checkpoint_close
+
+Returned Value: int (INTERP_OK)
+
+Ends the current pass.  The temporary sidecar replaces the existing one
+only if it got further into the program, so an aborted rerun does not
+throw away the checkpoints of a longer earlier run.
+*/
+int Interp::checkpoint_close(setup_pointer settings)
+{
+    if (settings->checkpoint_fp != NULL) {
+	std::string tmp = std::string(settings->checkpoint_file) + ".tmp";
+	fclose(settings->checkpoint_fp);
+	settings->checkpoint_fp = NULL;
+	if (settings->checkpoint_line > settings->checkpoint_prev_line)
+	    rename(tmp.c_str(), settings->checkpoint_file);
+	else
+	    unlink(tmp.c_str());
+    }
+    settings->checkpoint_base.clear();
+    return INTERP_OK;
+}
+
+/*! Interp::restore_checkpoint
+
+Returned Value: int
+   the line the open file resumes after, 0 if no usable checkpoint was
+   found and the file has to be read from the start, or -1 if restoring
+   the state failed halfway and the run has to be abandoned
+
+Called By: task, right after a run from a start line has been requested
+on a freshly opened file.
+
+At least one line is always left between the checkpoint and the start
+line so that task's existing skip path still synchs the position.
+*/
+int Interp::restore_checkpoint(int line)
+{
+    FORCE_LC_NUMERIC_C;
+    char buf[LINELEN + PATH_MAX];
+    char sidecar[PATH_MAX];
+    long record = -1;
+    int ckpt_line, best = 0;
+
+    if (_setup.file_pointer == NULL || _setup.call_level != 0 || line < 2 ||
+	_setup.sequence_number != (_setup.percent_flag ? 1 : 0))
+	return 0;
+
+    if (snprintf(sidecar, sizeof(sidecar), "%s" CHECKPOINT_SUFFIX,
+		 _setup.filename) >= (int) sizeof(sidecar))
+	return 0;
+    FILE *fp = fopen(sidecar, "r");
+    if (fp == NULL)
+	return 0;
+    if (!checkpoint_header_ok(fp, _setup.filename)) {
+	logDebug("restore_checkpoint: '%s' is stale, ignoring", sidecar);
+	fclose(fp);
+	return 0;
+    }
+
+    // find the last checkpoint that leaves at least one line to skip
+    long pos = ftell(fp);
+    while (fgets(buf, sizeof(buf), fp)) {
+	if (sscanf(buf, "CHECKPOINT %d", &ckpt_line) == 1 &&
+	    ckpt_line + 1 < line && ckpt_line > best) {
+	    best = ckpt_line;
+	    record = pos;
+	}
+	pos = ftell(fp);
+    }
+    if (record < 0) {
+	fclose(fp);
+	return 0;
+    }
+
+    // parse the whole record before touching any state
+    long file_offset = 0;
+    int executed_if = 0;
+    int saved_g[ACTIVE_G_CODES], saved_m[ACTIVE_M_CODES];
+    double saved_settings[ACTIVE_SETTINGS];
+    int motion_mode = G_80, cycle_l = 0, cycle_il_flag = 0;
+    double cycle_i = 0, cycle_j = 0, cycle_k = 0, cycle_p = 0;
+    double cycle_q = 0, cycle_r = 0, cycle_il = 0;
+    std::vector<std::pair<int, double> > params;
+    std::vector<std::pair<std::string, double> > named;
+    std::vector<std::pair<std::string, offset> > labels;
+    std::vector<std::string> label_files;
+    int fields = 0;
+    bool complete = false;
+
+    fseek(fp, record, SEEK_SET);
+    if (!fgets(buf, sizeof(buf), fp) ||
+	sscanf(buf, "CHECKPOINT %d %ld %d", &ckpt_line, &file_offset,
+	       &executed_if) != 3) {
+	fclose(fp);
+	return 0;
+    }
+    while (!complete && fgets(buf, sizeof(buf), fp)) {
+	char *s = buf + 1;
+	char *end;
+	int n;
+	buf[strcspn(buf, "\n")] = 0;
+	switch (buf[0]) {
+	case 'G':
+	    for (n = 0; n < ACTIVE_G_CODES; n++)
+		saved_g[n] = strtol(s, &s, 10);
+	    fields |= 1;
+	    break;
+	case 'M':
+	    for (n = 0; n < ACTIVE_M_CODES; n++)
+		saved_m[n] = strtol(s, &s, 10);
+	    fields |= 2;
+	    break;
+	case 'S':
+	    for (n = 0; n < ACTIVE_SETTINGS; n++)
+		saved_settings[n] = strtod(s, &s);
+	    fields |= 4;
+	    break;
+	case 'C':
+	    if (sscanf(s, "%d %d %lf %lf %lf %lf %lf %lf %d %lf",
+		       &motion_mode, &cycle_l, &cycle_i, &cycle_j, &cycle_k,
+		       &cycle_p, &cycle_q, &cycle_r,
+		       &cycle_il_flag, &cycle_il) == 10)
+		fields |= 8;
+	    break;
+	case 'P':
+	    n = strtol(s, &end, 10);
+	    if (n > 0 && n < interp_param_global::RS274NGC_MAX_PARAMETERS)
+		params.push_back(std::make_pair(n, strtod(end, NULL)));
+	    break;
+	case 'N': {
+	    double value = strtod(s, &end);
+	    while (*end == ' ') end++;
+	    named.push_back(std::make_pair(std::string(end), value));
+	    break;
+	}
+	case 'O': {
+	    offset o;
+	    char name[LINELEN];
+	    int used = 0;
+	    if (sscanf(s, "%d %ld %d %d %s %n", &o.type, &o.offset,
+		       &o.sequence_number, &o.repeat_count, name, &used) < 5 ||
+		used == 0)
+		break;
+	    labels.push_back(std::make_pair(std::string(name), o));
+	    label_files.push_back(std::string(s + used));
+	    break;
+	}
+	default:
+	    complete = !strcmp(buf, "END");
+	    break;
+	}
+    }
+    fclose(fp);
+    if (!complete || fields != 15) {
+	logDebug("restore_checkpoint: truncated record for line %d", ckpt_line);
+	return 0;
+    }
+
+    // parameters first: the coordinate system and G92 codes below read them
+    for (size_t i = 0; i < params.size(); i++)
+	_setup.parameters[params[i].first] = params[i].second;
+    for (size_t i = 0; i < named.size(); i++) {
+	snprintf(buf, sizeof(buf), "#<%s>=%.17g",
+		 named[i].first.c_str(), named[i].second);
+	if (execute(buf) != INTERP_OK)
+	    return -1;
+    }
+    for (size_t i = 0; i < labels.size(); i++) {
+	labels[i].second.filename = strstore(label_files[i].c_str());
+	_setup.offset_map[strstore(labels[i].first.c_str())] = labels[i].second;
+    }
+
+    // modal state, generated and executed like M72 so canon follows along
+    write_g_codes((block_pointer) NULL, &_setup);
+    write_m_codes((block_pointer) NULL, &_setup);
+    write_settings(&_setup);
+    if (_setup.active_g_codes[5] != saved_g[5]) {
+	snprintf(buf, sizeof(buf), "G%d", saved_g[5] / 10);
+	if (execute(buf) != INTERP_OK)
+	    return -1;
+	write_g_codes((block_pointer) NULL, &_setup);
+    }
+
+    int current_g[ACTIVE_G_CODES];
+    int current_m[ACTIVE_M_CODES];
+    double current_settings[ACTIVE_SETTINGS];
+    active_g_codes(current_g);
+    active_m_codes(current_m);
+    active_settings(current_settings);
+    // offsets may have changed under an unchanged G5x/G92.3 code
+    current_g[8] = -1;
+    current_g[16] = -1;
+
+    std::string cmd;
+    gen_settings(current_g, saved_g, current_settings, saved_settings, cmd);
+    cmd += "\n";
+    gen_m_codes(current_m, saved_m, cmd);
+
+    char lines[cmd.size() + 1];
+    strncpy(lines, cmd.c_str(), sizeof(lines));
+    char *last = lines;
+    char *s;
+    while ((s = strtok_r(last, "\n", &last)) != NULL) {
+	if (execute(s) != INTERP_OK) {
+	    logDebug("restore_checkpoint: '%s' failed: %s", s, getSavedError());
+	    return -1;
+	}
+    }
+
+    _setup.motion_mode = motion_mode;
+    _setup.cycle_l = cycle_l;
+    _setup.cycle_i = cycle_i;
+    _setup.cycle_j = cycle_j;
+    _setup.cycle_k = cycle_k;
+    _setup.cycle_p = cycle_p;
+    _setup.cycle_q = cycle_q;
+    _setup.cycle_r = cycle_r;
+    _setup.cycle_il_flag = cycle_il_flag;
+    _setup.cycle_il = cycle_il;
+    _setup.executed_if = executed_if;
+
+    fseek(_setup.file_pointer, file_offset, SEEK_SET);
+    _setup.sequence_number = ckpt_line;
+    write_g_codes((block_pointer) NULL, &_setup);
+    write_m_codes((block_pointer) NULL, &_setup);
+    write_settings(&_setup);
+
+    logDebug("restore_checkpoint: resuming '%s' after line %d for start line %d",
+	     _setup.filename, ckpt_line, line);
+    return ckpt_line;
+}
@@ -20,6 +20,7 @@
 #include <stdio.h>
 #include <set>
 #include <map>
+#include <vector>
 #include <bitset>
 #include "canon.hh"
 #include "emcpos.h"
@@ -811,6 +812,14 @@ struct setup
 
   int disable_g92_persistence;
 
+  // run-from-line checkpoints, see interp_checkpoint.cc
+  int checkpoint_interval;           // lines between checkpoints, 0 = off
+  int checkpoint_line;               // line of the last checkpoint written
+  int checkpoint_prev_line;          // last line covered by the existing sidecar
+  FILE *checkpoint_fp;               // sidecar being written, or NULL
+  char checkpoint_file[PATH_MAX];    // sidecar name of the file being written
+  std::vector<double> checkpoint_base; // parameters at the start of the pass
+
 #define FEATURE(x) (_setup.feature_set & FEATURE_ ## x)
 #define FEATURE_RETAIN_G43           0x00000001
 #define FEATURE_OWORD_N_ARGS         0x00000002
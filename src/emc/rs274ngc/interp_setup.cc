@@ -177,6 +177,12 @@ setup::setup() :
     disable_fanuc_style_sub(false),
     loop_on_main_m99(false),
     disable_g92_persistence(0),
+    checkpoint_interval(0),
+    checkpoint_line(0),
+    checkpoint_prev_line(0),
+    checkpoint_fp(NULL),
+    checkpoint_file{},
+    checkpoint_base(),
     pythis(),
     on_abort_command(NULL),
     init_once(CANON_STOPPED)
@@ -66,6 +66,13 @@ public:
  int save_parameters(const char *filename,
                                     const double parameters[]);
 
+// append a run-from-line checkpoint to the sidecar file if one is due
+ int checkpoint(bool begin);
+
+// resume the open file from the last checkpoint before line,
+// returning the line resumed from or 0
+ int restore_checkpoint(int line);
+
 // synchronize your internal model with the external world
  int synch();
 
@@ -473,6 +480,8 @@ int read_dollar(char *line, int *counter, block_pointer block,
  int save_settings(setup_pointer settings);
  int restore_settings(setup_pointer settings, int from_level);
  int restore_from_tag(StateTag const &tag);
+ int checkpoint_close(setup_pointer settings);
+ bool checkpoint_allowed(setup_pointer settings);
  int gen_settings(
      int *int_current, int *int_saved,
      double *float_current, double *float_saved,
@@ -242,6 +242,7 @@ Called By: external programs
 int Interp::close()
 {
     logOword("Interp::close()");
+    checkpoint_close(&_setup);
     // be "lazy" only if we're not aborting a call in progress
     // in which case we need to reset() the call stack
     // this does not reset the filename properly 
@@ -1070,6 +1071,12 @@ int Interp::init()
 	  logDebug("init:  DISABLE_FANUC_STYLE_SUB = %d",
 		   _setup.disable_fanuc_style_sub);
 
+	  // run-from-line checkpoint spacing, 0 disables
+	  _setup.checkpoint_interval = 0;
+	  inifile.Find(&_setup.checkpoint_interval,
+		       "CHECKPOINT_INTERVAL",
+		       "RS274NGC");
+
           // close it
           inifile.Close();
       }
@@ -624,6 +624,27 @@ int emcTaskPlanExecute(const char *command, int line_number)
     return retval;
 }
 
+int emcTaskPlanCheckpoint(bool begin)
+{
+    int retval = interp.checkpoint(begin);
+    if (retval > INTERP_MIN_ERROR) {
+	print_interp_error(retval);
+    }
+
+    return retval;
+}
+
+int emcTaskPlanRestoreCheckpoint(int line)
+{
+    int retval = interp.restore_checkpoint(line);
+
+    if (emc_debug & EMC_DEBUG_INTERP) {
+        rcs_print("emcTaskPlanRestoreCheckpoint(%d) returned %d\n", line, retval);
+    }
+
+    return retval;
+}
+
 int emcTaskPlanClose()
 {
     int retval = interp.close();
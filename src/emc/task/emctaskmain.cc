@@ -565,6 +565,9 @@ interpret_again:
 			    } else {
 
 				// executed a good line
+				if (programStartLine == 0) {
+				    emcTaskPlanCheckpoint(false);
+				}
 			    }
 
 			    // throw the results away if we're supposed to
@@ -2240,6 +2243,23 @@ static int emcTaskIssueCommand(NMLmsg * cmd)
 	}
 	run_msg = (EMC_TASK_PLAN_RUN *) cmd;
 	programStartLine = run_msg->line;
+	if (programStartLine == 0) {
+	    emcTaskPlanCheckpoint(true);
+	} else if (programStartLine > 0) {
+	    // jump close to the start line; the lines in between are
+	    // still stepped over below
+	    int resumed = emcTaskPlanRestoreCheckpoint(programStartLine);
+	    // the restore only replays modal state, its motion is discarded
+	    // just like that of the skipped lines
+	    interp_list.clear();
+	    if (resumed < 0) {
+		emcOperatorError(_("Run from line: could not restore checkpoint"));
+		emcTaskPlanClose();
+		programStartLine = 0;
+		retval = -1;
+		break;
+	    }
+	}
 	emcStatus->task.interpState = EMC_TASK_INTERP::READING;
 	emcStatus->task.task_paused = 0;
 	retval = 0;
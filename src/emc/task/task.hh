@@ -50,6 +50,8 @@ int emcTaskPlanExecute(const char *command, int line_number); //used in case of
 int emcTaskPlanPause();
 int emcTaskPlanResume();
 int emcTaskPlanClose();
+int emcTaskPlanCheckpoint(bool begin);
+int emcTaskPlanRestoreCheckpoint(int line);
 int emcTaskPlanReset();
 
 int emcTaskPlanLine();
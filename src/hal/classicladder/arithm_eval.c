@@ -41,10 +41,12 @@
 #endif
 #include "arithm_eval.h"
 #include <rtapi_string.h>
+#include <rtapi_atomic.h>
 
 
 char * Expr;
 char * ErrorDesc;
+int CompileFailed;
 char * VerifyErrorDesc;
 int UnderVerify;
 
@@ -69,6 +71,7 @@ int pow_int(int a,int b)
 
 void SyntaxError(void)
 {
+	CompileFailed = TRUE;
 	if (UnderVerify)
 		VerifyErrorDesc = ErrorDesc;
 	else
@@ -224,30 +227,46 @@ int IdentifyVarIndexedOrNot(char *StartExpr,int * ResType,int * ResOffset, int *
 	return FALSE;
 }
 
-/* Give final variable (taking into account the value of an index if present) */
-int IdentifyFinalVar( char *StartExpr, int * ResType,int * ResOffset )
+/* The expressions are compiled one time (when loaded or applied) to */
+/* a little stack code, so that the refresh has only to execute it */
+/* instead of parsing the text again at each scan. */
+/* The parser below is the one of the original evaluator, it just */
+/* emits an op where it was calculating a value. */
+
+StrArithmOp * CodeOut;
+int NbrOpsOut;
+
+void Emit(char Op, char Arg, int VarType, int Value, int IndexVarType, int IndexVarOffset)
 {
-	int IndexVarType,IndexVarOffset;
-	int SyntaxOk = IdentifyVarIndexedOrNot( StartExpr, ResType, ResOffset, &IndexVarType, &IndexVarOffset );
-	if ( SyntaxOk )
+	StrArithmOp * pOp;
+	if ( NbrOpsOut>=ARITHM_CODE_SIZE )
 	{
-		if ( IndexVarType!=-1 && IndexVarOffset!=-1 )
+		if ( !CompileFailed )
 		{
-			// add index value from content of the index variable
-			int IndexValue = ReadVar( IndexVarType, IndexVarOffset );
-			*ResOffset = *ResOffset + IndexValue;
+			ErrorDesc = "Expression too complex";
+			SyntaxError();
 		}
-//printf("Final var for %s => %d/%d\n", StartExpr, *ResType, *ResOffset );
+		return;
 	}
-	return SyntaxOk;
+	pOp = &CodeOut[ NbrOpsOut++ ];
+	pOp->Op = Op;
+	pOp->Arg = Arg;
+	pOp->VarType = VarType;
+	pOp->Value = Value;
+	pOp->IndexVarType = IndexVarType;
+	pOp->IndexVarOffset = IndexVarOffset;
 }
 
-arithmtype Variable(void)
+void EmitOp(char Op, char Arg)
 {
-	int VarType,VarOffset;
-	if (IdentifyFinalVar(Expr, &VarType,&VarOffset))
+	Emit( Op, Arg, 0, 0, -1, -1 );
+}
+
+void Variable(void)
+{
+	int VarType,VarOffset,IndexVarType,IndexVarOffset;
+	if (IdentifyVarIndexedOrNot(Expr, &VarType,&VarOffset,&IndexVarType,&IndexVarOffset))
 	{
-//printf("Variable:%d/%d\n", VarType, VarOffset);
 		/* flush var found */
 		Expr++;
 		do
@@ -255,20 +274,17 @@ arithmtype Variable(void)
 			Expr++;
 		}
 		while( (*Expr!='@') && (*Expr!='\0') );
-		Expr++;
-		/* return var value */
-		return (arithmtype)ReadVar(VarType,VarOffset);
-	}
-	else
-	{
-		return 0;
+		if ( *Expr=='@' )
+			Expr++;
+		Emit( ARITHM_OP_VAR, 0, VarType, VarOffset, IndexVarType, IndexVarOffset );
 	}
 }
 
-arithmtype Function(void)
+void Function(void)
 {
 	char tcFonc[ 20 ], *pFonc;
-	int Res = 0;
+	char Op = -1;
+	int NbrVars = 0;
 
 	/* which function ? */
 	pFonc = tcFonc;
@@ -283,288 +299,185 @@ arithmtype Function(void)
 	if ( !strcmp(tcFonc, "ABS") )
 	{
 		Expr++; /* ( */
-		Res = Variable( );
-		if ( Res<0 )
-			Res = Res * -1;
+		Variable( );
 		if ( *Expr!=')' )
 		{
 			ErrorDesc = "Missing end ) after the only variable in ABS() function";
 			SyntaxError();
-			return 0;
+			return;
 		}
 		Expr++; /* ) */
-		return Res;
+		EmitOp( ARITHM_OP_ABS, 0 );
+		return;
 	}
 
 	/* functions with many parameters = many variables separated per ',' */
 	if ( !strcmp(tcFonc, "MINI") )
-	{
-		Res = 0x7FFFFFFF;
-		do
-		{
-			int iValVar;
-			Expr++; /* ( -ou- , */
-			iValVar = Variable( );
-			if ( iValVar<Res )
-				Res = iValVar;
-		}
-		while( *Expr!=')' );
-		Expr++; /* ) */
-		return Res;
-	}
+		Op = ARITHM_OP_MINI;
 	if ( !strcmp(tcFonc, "MAXI") )
-	{
-		Res = 0x80000000;
-		do
-		{
-			int iValVar;
-			Expr++; /* ( -or- , */
-			iValVar = Variable( );
-			if ( iValVar>Res )
-				Res = iValVar;
-		}
-		while( *Expr!=')' );
-		Expr++; /* ) */
-		return Res;
-	}
+		Op = ARITHM_OP_MAXI;
 	if ( !strcmp(tcFonc, "MOY") /*original french term!*/ || !strcmp(tcFonc, "AVG") /*added latter!!!*/ )
+		Op = ARITHM_OP_AVG;
+	if ( Op!=-1 )
 	{
-		int NbrVars = 0;
 		do
 		{
-			int ValVar;
 			Expr++; /* ( -or- , */
-			ValVar = Variable( );
+			Variable( );
 			NbrVars++;
-			Res = Res + ValVar;
 		}
-		while( *Expr!=')' );
+		while( *Expr!=')' && *Expr!='\0' && !CompileFailed );
+		if ( *Expr!=')' )
+		{
+			ErrorDesc = "Missing end ) after the variables of the function";
+			SyntaxError();
+			return;
+		}
 		Expr++; /* ) */
-		Res = Res/NbrVars;
-		return Res;
+		EmitOp( Op, NbrVars );
+		return;
 	}
 
-	/* functions with parameter = term */
-//	int iValeurTerm = Term();
-//	if ( !strcmp(tcFonc, "") )
-//	{
-//	}
-
-
 	ErrorDesc = "Unknown function";
 	SyntaxError();
-
-	return 0;
 }
 
-arithmtype Term(void)
+void Term(void)
 {
-//if (UnderVerify)
-//printf("Term_Expr=%s (%c)\n",Expr, *Expr);
 	if (*Expr=='(')
 	{
-		arithmtype Res;
 		Expr++;
-//		Res = AddSub();
-		Res = Or();
+		Or();
 		if (*Expr!=')')
 		{
 			ErrorDesc = "Missing parenthesis";
 			SyntaxError();
+			return;
 		}
 		Expr++;
-		return Res;
 	}
 	else if ( (*Expr>='0' && *Expr<='9') || (*Expr=='$') || (*Expr=='-') || (*Expr=='\'') )
-		return Constant();
+		Emit( ARITHM_OP_CONST, 0, 0, Constant(), -1, -1 );
 	else if (*Expr>='A' && *Expr<='Z')
-		return Function();
+		Function();
 	else if (*Expr=='@')
-	{
-		return Variable();
-	}
+		Variable();
 	else if (*Expr=='!')
 	{
 		Expr++;
-		return Term()?0:1;
+		Term();
+		EmitOp( ARITHM_OP_NOT, 0 );
 	}
 	else
 	{
-if (UnderVerify)
-rtapi_print("TermERROR!_ExprHere=%s\n",Expr);
 		ErrorDesc = "Unknown term";
 		SyntaxError();
-		return 0;
 	}
-//	return 0;
 }
 
-arithmtype Pow(void)
+void Pow(void)
 {
-	arithmtype Q,Res = Term();
+	Term();
 	while(*Expr=='^')
 	{
 		if ( ErrorDesc )
 			break;
 		Expr++;
-		Q = Pow();
-		Res = pow_int(Res,Q);
+		Pow();
+		EmitOp( ARITHM_OP_POW, 0 );
 	}
-	return Res;
 }
 
-arithmtype MulDivMod(void)
+void MulDivMod(void)
 {
-	int Val=0;
-	arithmtype Res = Pow();
+	char Op;
+	Pow();
 	while(1)
 	{
 		if ( ErrorDesc )
 			break;
-//if (UnderVerify)
-//printf("MulDivMod_Expr=%s\n",Expr);
 		if (*Expr=='*')
-		{
-			Expr++;
-			Res = Res * Pow();
-		}
-		else
-		if (*Expr=='/')
-		{
-			Expr++;
-			Val = Pow();
-			if ( ErrorDesc==NULL )
-				Res = Res / Val;
-		}
+			Op = ARITHM_OP_MUL;
+		else if (*Expr=='/')
+			Op = ARITHM_OP_DIV;
+		else if (*Expr=='%')
+			Op = ARITHM_OP_MOD;
 		else
-		if (*Expr=='%')
-		{
-			Expr++;
-			Val = Pow();
-			if ( ErrorDesc==NULL )
-				Res = Res % Val;
-		}
-		else
-		{
 			break;
-		}
+		Expr++;
+		Pow();
+		EmitOp( Op, 0 );
 	}
-	return Res;
 }
 
-arithmtype AddSub(void)
+void AddSub(void)
 {
-	arithmtype Res = MulDivMod();
+	char Op;
+	MulDivMod();
 	while(1)
 	{
 		if ( ErrorDesc )
 			break;
-//if (UnderVerify)
-//printf("AddSub_Expr=%s\n",Expr);
 		if (*Expr=='+')
-		{
-			Expr++;
-			Res = Res + MulDivMod();
-		}
-		else
-		if (*Expr=='-')
-		{
-			Expr++;
-			Res = Res - MulDivMod();
-		}
+			Op = ARITHM_OP_ADD;
+		else if (*Expr=='-')
+			Op = ARITHM_OP_SUB;
 		else
-		{
 			break;
-		}
+		Expr++;
+		MulDivMod();
+		EmitOp( Op, 0 );
 	}
-	return Res;
 }
 
-arithmtype And(void)
+void And(void)
 {
-	arithmtype Res = AddSub();
-	while(1)
+	AddSub();
+	while( !ErrorDesc && *Expr=='&' )
 	{
-		if ( ErrorDesc )
-			break;
-		if (*Expr=='&')
-		{
-			Expr++;
-			Res = Res & AddSub();
-		}
-		else
-		{
-			break;
-		}
+		Expr++;
+		AddSub();
+		EmitOp( ARITHM_OP_AND, 0 );
 	}
-	return Res;
 }
-arithmtype Xor(void)
+void Xor(void)
 {
-	arithmtype Res = And();
-	while(1)
+	And();
+	while( !ErrorDesc && *Expr=='^' )
 	{
-		if ( ErrorDesc )
-			break;
-		if (*Expr=='^')
-		{
-			Expr++;
-			Res = Res ^ And();
-		}
-		else
-		{
-			break;
-		}
+		Expr++;
+		And();
+		EmitOp( ARITHM_OP_XOR, 0 );
 	}
-	return Res;
 }
-arithmtype Or(void)
+void Or(void)
 {
-	arithmtype Res = Xor();
-	while(1)
+	Xor();
+	while( !ErrorDesc && *Expr=='|' )
 	{
-		if ( ErrorDesc )
-			break;
-		if (*Expr=='|')
-		{
-			Expr++;
-			Res = Res | Xor();
-		}
-		else
-		{
-			break;
-		}
+		Expr++;
+		Xor();
+		EmitOp( ARITHM_OP_OR, 0 );
 	}
-	return Res;
 }
 
-arithmtype EvalExpression(char * ExprString)
+void CompileExpression(char * ExprString)
 {
-	arithmtype Res;
 	Expr = ExprString;
-//    Res = AddSub();
 	ErrorDesc = NULL;
-	Res = Or();
-
-	return Res;
+	Or();
 }
 
-
-
-/* Result of the comparison of 2 arithmetics expressions : */
+/* Comparison of 2 arithmetics expressions : */
 /* Expr1 ... Expr2 where ... can be : < , > , = , <= , >= , <> */
-int EvalCompare(char * CompareString)
+void CompileCompare(char * CompareString)
 {
 	char * FirstExpr,* SecondExpr = NULL;
 	char StrCopy[ARITHM_EXPR_SIZE+1]; /* used for putting null char after first expr */
 	char * SearchSep;
 	char * CutFirst;
 	int Found = FALSE;
-	int BoolRes = 0;
-
-	/* null expression ? */
-	if (*CompareString=='\0' || *CompareString=='#')
-		return BoolRes;
+	char Flags = 0;
 
 	rtapi_strxcpy(StrCopy,CompareString);
 
@@ -595,46 +508,38 @@ int EvalCompare(char * CompareString)
 	while (*SearchSep!='\0' && !Found);
 	if (Found)
 	{
-		arithmtype EvalFirst,EvalSecond;
-//printf("EvalCompare FirstString=%s , SecondString=%s\n",FirstExpr,SecondExpr);
-		EvalFirst = EvalExpression(FirstExpr);
-		EvalSecond = EvalExpression(SecondExpr);
-//printf("EvalCompare ResultFirst=%d , ResultSecond=%d\n",EvalFirst,EvalSecond);
-		/* verify if compare is true */
-		if ( *SearchSep=='>' && EvalFirst>EvalSecond )
-			BoolRes = 1;
-		if ( *SearchSep=='<' && *(SearchSep+1)!='>' && EvalFirst<EvalSecond )
-			BoolRes = 1;
-		if ( *SearchSep=='<' && *(SearchSep+1)=='>' && EvalFirst!=EvalSecond )
-			BoolRes = 1;
-		if ( (*SearchSep=='=' || *(SearchSep+1)=='=') && EvalFirst==EvalSecond )
-			BoolRes = 1;
+		CompileExpression(FirstExpr);
+		CompileExpression(SecondExpr);
+		/* which results make the compare true */
+		if ( *SearchSep=='>' )
+			Flags |= ARITHM_CMP_GT;
+		if ( *SearchSep=='<' && *(SearchSep+1)!='>' )
+			Flags |= ARITHM_CMP_LT;
+		if ( *SearchSep=='<' && *(SearchSep+1)=='>' )
+			Flags |= ARITHM_CMP_NE;
+		if ( *SearchSep=='=' || *(SearchSep+1)=='=' )
+			Flags |= ARITHM_CMP_EQ;
+		EmitOp( ARITHM_OP_COMPARE, Flags );
 	}
 	else
 	{
 		ErrorDesc = "Missing < or > or = or ... to make compare";
 		SyntaxError();
 	}
-//printf("Eval FinalBoolResult = %d\n",BoolRes);
-	return BoolRes;
 }
 
-/* Calc the new value of a variable from an arithmetic expression : */
+/* New value of a variable from an arithmetic expression : */
 /* VarDest := ArithmExpr */
-void MakeCalc(char * CalcString,int VerifyMode)
+void CompileCalc(char * CalcString,int VerifyMode)
 {
-	char StrCopy[ARITHM_EXPR_SIZE+1]; /* used for putting null char after first expr */
-	int TargetVarType,TargetVarOffset;
+	char StrCopy[ARITHM_EXPR_SIZE+1];
+	int TargetVarType,TargetVarOffset,IndexVarType,IndexVarOffset;
 	int  Found = FALSE;
 
-	/* null expression ? */
-	if (*CalcString=='\0' || *CalcString=='#')
-		return;
-
 	rtapi_strxcpy(StrCopy,CalcString);
 
 	Expr = StrCopy;
-	if (IdentifyFinalVar(Expr,&TargetVarType,&TargetVarOffset))
+	if (IdentifyVarIndexedOrNot(Expr,&TargetVarType,&TargetVarOffset,&IndexVarType,&IndexVarOffset))
 	{
 		/* flush var found */
 		Expr++;
@@ -643,7 +548,8 @@ void MakeCalc(char * CalcString,int VerifyMode)
 			Expr++;
 		}
 		while( (*Expr!='@') && (*Expr!='\0') );
-		Expr++;
+		if ( *Expr=='@' )
+			Expr++;
 		/* verify if there is the '=' or ':=' */
 		do
 		{
@@ -662,16 +568,10 @@ void MakeCalc(char * CalcString,int VerifyMode)
 			Expr++;
 		if (Found)
 		{
-			arithmtype EvalExpr;
-//printf("Calc - Eval String=%s\n",Expr);
-			EvalExpr = EvalExpression(Expr);
-//printf("Calc - Result=%d\n",EvalExpr);
-			if (!VerifyMode)
-			{
-				WriteVar(TargetVarType,TargetVarOffset,(int)EvalExpr);
-			}
+			CompileExpression(Expr);
+			Emit( ARITHM_OP_STORE, 0, TargetVarType, TargetVarOffset, IndexVarType, IndexVarOffset );
 #ifdef GTK_INTERFACE
-			else
+			if ( VerifyMode )
 			{
 				if ( !TestVarIsReadWrite( TargetVarType, TargetVarOffset ) )
 				{
@@ -689,13 +589,132 @@ void MakeCalc(char * CalcString,int VerifyMode)
 	}
 }
 
+int Compile(char * ExprString, int TypeElement, int VerifyMode, StrArithmOp * Code)
+{
+	/* null expression ? */
+	if (*ExprString=='\0' || *ExprString=='#')
+		return 0;
+	CodeOut = Code;
+	NbrOpsOut = 0;
+	CompileFailed = FALSE;
+	if ( TypeElement==ELE_COMPAR )
+		CompileCompare(ExprString);
+	else
+		CompileCalc(ExprString,VerifyMode);
+	return CompileFailed?0:NbrOpsOut;
+}
+
+/* Compile a compare (ELE_COMPAR) or operate (ELE_OUTPUT_OPERATE) expression */
+/* return the number of ops written in Code, 0 if empty or invalid */
+int CompileArithmExpr(char * ExprString, int TypeElement, StrArithmOp * Code)
+{
+	return Compile(ExprString, TypeElement, FALSE, Code);
+}
+
+/* (Re)compile ArithmExpr[NumExpr] if its text has changed. The refresh */
+/* may be running: the new code is only given to it once complete. */
+void UpdateArithmCode(int NumExpr, int TypeElement)
+{
+	StrArithmExpr * pArithm = &ArithmExpr[ NumExpr ];
+	StrArithmOp Code[ ARITHM_CODE_SIZE ];
+	int NbrOps;
+	memset( Code, 0, sizeof(Code) );
+	NbrOps = CompileArithmExpr( pArithm->Expr, TypeElement, Code );
+	if ( NbrOps==atomic_load_explicit( &pArithm->NbrOps, memory_order_acquire )
+		&& memcmp( Code, pArithm->Code, NbrOps*sizeof(StrArithmOp) )==0 )
+		return;
+	atomic_store_explicit( &pArithm->NbrOps, 0, memory_order_release );
+	memcpy( pArithm->Code, Code, NbrOps*sizeof(StrArithmOp) );
+	atomic_store_explicit( &pArithm->NbrOps, NbrOps, memory_order_release );
+}
+
+/* Execute a compiled expression, return the result of the compare */
+/* (or the value stored for an operate) */
+arithmtype ExecArithmCode(StrArithmOp * Code, int NbrOps)
+{
+	/* no more values pushed than ops */
+	arithmtype Stack[ ARITHM_CODE_SIZE ];
+	int Top = -1;
+	int Offset, Scan;
+	StrArithmOp * pOp;
+	for( pOp=Code; pOp<Code+NbrOps; pOp++ )
+	{
+		switch( pOp->Op )
+		{
+			case ARITHM_OP_CONST:
+				Stack[ ++Top ] = pOp->Value;
+				break;
+			case ARITHM_OP_VAR:
+			case ARITHM_OP_STORE:
+				Offset = pOp->Value;
+				// add index value from content of the index variable
+				if ( pOp->IndexVarType!=-1 && pOp->IndexVarOffset!=-1 )
+					Offset += ReadVar( pOp->IndexVarType, pOp->IndexVarOffset );
+				if ( pOp->Op==ARITHM_OP_VAR )
+					Stack[ ++Top ] = (arithmtype)ReadVar( pOp->VarType, Offset );
+				else
+					WriteVar( pOp->VarType, Offset, (int)Stack[ Top ] );
+				break;
+			case ARITHM_OP_NOT:
+				Stack[ Top ] = Stack[ Top ]?0:1;
+				break;
+			case ARITHM_OP_ABS:
+				if ( Stack[ Top ]<0 )
+					Stack[ Top ] = Stack[ Top ] * -1;
+				break;
+			case ARITHM_OP_MINI:
+			case ARITHM_OP_MAXI:
+			case ARITHM_OP_AVG:
+				Top = Top-pOp->Arg+1;
+				for( Scan=1; Scan<pOp->Arg; Scan++ )
+				{
+					arithmtype ValVar = Stack[ Top+Scan ];
+					if ( pOp->Op==ARITHM_OP_MINI && ValVar<Stack[ Top ] )
+						Stack[ Top ] = ValVar;
+					else if ( pOp->Op==ARITHM_OP_MAXI && ValVar>Stack[ Top ] )
+						Stack[ Top ] = ValVar;
+					else if ( pOp->Op==ARITHM_OP_AVG )
+						Stack[ Top ] += ValVar;
+				}
+				if ( pOp->Op==ARITHM_OP_AVG )
+					Stack[ Top ] = Stack[ Top ]/pOp->Arg;
+				break;
+			case ARITHM_OP_COMPARE:
+				Top--;
+				Stack[ Top ] = ( (pOp->Arg&ARITHM_CMP_GT) && Stack[ Top ]>Stack[ Top+1 ] )
+					|| ( (pOp->Arg&ARITHM_CMP_LT) && Stack[ Top ]<Stack[ Top+1 ] )
+					|| ( (pOp->Arg&ARITHM_CMP_NE) && Stack[ Top ]!=Stack[ Top+1 ] )
+					|| ( (pOp->Arg&ARITHM_CMP_EQ) && Stack[ Top ]==Stack[ Top+1 ] );
+				break;
+			default:
+				/* binary operators */
+				Top--;
+				switch( pOp->Op )
+				{
+					case ARITHM_OP_POW: Stack[ Top ] = pow_int( Stack[ Top ], Stack[ Top+1 ] ); break;
+					case ARITHM_OP_MUL: Stack[ Top ] = Stack[ Top ] * Stack[ Top+1 ]; break;
+					case ARITHM_OP_DIV: Stack[ Top ] = Stack[ Top ] / Stack[ Top+1 ]; break;
+					case ARITHM_OP_MOD: Stack[ Top ] = Stack[ Top ] % Stack[ Top+1 ]; break;
+					case ARITHM_OP_ADD: Stack[ Top ] = Stack[ Top ] + Stack[ Top+1 ]; break;
+					case ARITHM_OP_SUB: Stack[ Top ] = Stack[ Top ] - Stack[ Top+1 ]; break;
+					case ARITHM_OP_AND: Stack[ Top ] = Stack[ Top ] & Stack[ Top+1 ]; break;
+					case ARITHM_OP_XOR: Stack[ Top ] = Stack[ Top ] ^ Stack[ Top+1 ]; break;
+					case ARITHM_OP_OR: Stack[ Top ] = Stack[ Top ] | Stack[ Top+1 ]; break;
+				}
+				break;
+		}
+	}
+	return Top>=0?Stack[ Top ]:0;
+}
+
 /* Used one time after user input to verify syntax only */
 /* return NULL if ok, else pointer on error description */
 char * VerifySyntaxForEvalCompare(char * StringToVerify)
 {
+	StrArithmOp Code[ ARITHM_CODE_SIZE ];
 	UnderVerify = TRUE;
 	VerifyErrorDesc = NULL;
-	EvalCompare(StringToVerify);
+	Compile(StringToVerify, ELE_COMPAR, TRUE /* verify mode */, Code);
 	UnderVerify = FALSE;
 	return VerifyErrorDesc;
 }
@@ -703,10 +722,10 @@ char * VerifySyntaxForEvalCompare(char * StringToVerify)
 /* return NULL if ok, else pointer on error description */
 char * VerifySyntaxForMakeCalc(char * StringToVerify)
 {
+	StrArithmOp Code[ ARITHM_CODE_SIZE ];
 	UnderVerify = TRUE;
 	VerifyErrorDesc = NULL;
-	MakeCalc(StringToVerify,TRUE /* verify mode */);
+	Compile(StringToVerify, ELE_OUTPUT_OPERATE, TRUE /* verify mode */, Code);
 	UnderVerify = FALSE;
 	return VerifyErrorDesc;
 }
-
@@ -17,11 +17,38 @@
 #define arithmtype int
 
 
+/* ops of the compiled expressions (StrArithmOp) */
+#define ARITHM_OP_CONST 0
+#define ARITHM_OP_VAR 1
+#define ARITHM_OP_NOT 2
+#define ARITHM_OP_ABS 3
+#define ARITHM_OP_MINI 4
+#define ARITHM_OP_MAXI 5
+#define ARITHM_OP_AVG 6
+#define ARITHM_OP_POW 7
+#define ARITHM_OP_MUL 8
+#define ARITHM_OP_DIV 9
+#define ARITHM_OP_MOD 10
+#define ARITHM_OP_ADD 11
+#define ARITHM_OP_SUB 12
+#define ARITHM_OP_AND 13
+#define ARITHM_OP_XOR 14
+#define ARITHM_OP_OR 15
+#define ARITHM_OP_COMPARE 16
+#define ARITHM_OP_STORE 17
+
+/* flags of ARITHM_OP_COMPARE: results for which the compare is true */
+#define ARITHM_CMP_GT 1
+#define ARITHM_CMP_LT 2
+#define ARITHM_CMP_NE 4
+#define ARITHM_CMP_EQ 8
+
 int IdentifyVarIndexedOrNot(char * StartExpr,int * ResType,int * ResOffset, int * ResIndexType,int * ResIndexOffset);
-int EvalCompare(char * CompareString);
-void MakeCalc(char * CalcString,int VerifyMode);
-arithmtype AddSub(void);
-arithmtype Or(void);
+void AddSub(void);
+void Or(void);
+int CompileArithmExpr(char * ExprString, int TypeElement, StrArithmOp * Code);
+void UpdateArithmCode(int NumExpr, int TypeElement);
+arithmtype ExecArithmCode(StrArithmOp * Code, int NbrOps);
 char * VerifySyntaxForEvalCompare(char * StringToVerify);
 char * VerifySyntaxForMakeCalc(char * StringToVerify);
 
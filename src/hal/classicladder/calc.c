@@ -41,6 +41,7 @@
 #endif
 #include "calc.h"
 #include <rtapi_string.h>
+#include <rtapi_atomic.h>
 
 void InitRungs()
 {
@@ -67,6 +68,7 @@ void InitRungs()
 				RungArray[NumRung].Element[x][y].DynamicOutput = 0;
 			}
 		}
+		RungArray[NumRung].NbrCellsPlan = -1;
 	}
 	// the rung used in the default section created per default
 	InfosGene->FirstRung = 0;
@@ -74,6 +76,28 @@ void InitRungs()
 	InfosGene->CurrentRung = 0;
 	RungArray[0].Used = TRUE;
 }
+/* List the cells of the rung that RefreshRung() has to do, in the same */
+/* order than the grid. A free cell does nothing, only its DynamicInput */
+/* is used for drawing when it has a connection with top. */
+/* The refresh may be running: the list is given to it once complete. */
+void PlanRung(StrRung * Rung)
+{
+	unsigned char CellsPlan[RUNG_WIDTH*RUNG_HEIGHT];
+	int NbrCells = 0;
+	int x,y;
+	for(x=0;x<RUNG_WIDTH;x++)
+	{
+		for (y=0;y<RUNG_HEIGHT;y++)
+		{
+			StrElement * Element = &Rung->Element[x][y];
+			if ( (Element->Type!=ELE_FREE && Element->Type!=ELE_UNUSABLE) || Element->ConnectedWithTop )
+				CellsPlan[ NbrCells++ ] = x*RUNG_HEIGHT+y;
+		}
+	}
+	atomic_store_explicit( &Rung->NbrCellsPlan, -1, memory_order_release );
+	memcpy( Rung->CellsPlan, CellsPlan, NbrCells );
+	atomic_store_explicit( &Rung->NbrCellsPlan, NbrCells, memory_order_release );
+}
 /* Set DynamicVarBak (Element) to the right value before calculating the rungs */
 /* for detecting rising/falling edges used in some elements */
 void PrepareRungs()
@@ -83,6 +107,7 @@ void PrepareRungs()
 	char StateElement;
 	for (NumRung=0;NumRung<NBR_RUNGS;NumRung++)
 	{
+		PlanRung( &RungArray[NumRung] );
 		for (y=0;y<RUNG_HEIGHT;y++)
 		{
 			for(x=0;x<RUNG_WIDTH;x++)
@@ -204,6 +229,7 @@ void PrepareAllDatasBeforeRun( )
 	PrepareCounters( );
 	PrepareTimersIEC( );
 	PrepareRungs( );
+	PrepareArithmExpr( );
 #ifdef SEQUENTIAL_SUPPORT
 	PrepareSequential( );
 #endif
@@ -213,7 +239,31 @@ void InitArithmExpr()
 {
     int NumExpr;
     for (NumExpr=0; NumExpr<NBR_ARITHM_EXPR; NumExpr++)
+    {
         rtapi_strxcpy(ArithmExpr[NumExpr].Expr,"");
+        ArithmExpr[NumExpr].NbrOps = 0;
+    }
+}
+/* Compile the expressions of the compare/operate elements, the refresh */
+/* only executes the code (see arithm_eval.c) */
+void PrepareArithmExpr()
+{
+	int NumRung;
+	int x,y;
+	for (NumRung=0;NumRung<NBR_RUNGS;NumRung++)
+	{
+		if ( !RungArray[NumRung].Used )
+			continue;
+		for (y=0;y<RUNG_HEIGHT;y++)
+		{
+			for(x=0;x<RUNG_WIDTH;x++)
+			{
+				StrElement * Element = &RungArray[NumRung].Element[x][y];
+				if ( (Element->Type==ELE_COMPAR) || (Element->Type==ELE_OUTPUT_OPERATE) )
+					UpdateArithmCode( Element->VarNum, Element->Type );
+			}
+		}
+	}
 }
 void InitIOConf( )
 {
@@ -664,8 +714,9 @@ char CalcTypeCompar(int x,int y,StrRung * UpdateRung)
 {
     char State;
     char StateElement;
+    StrArithmExpr * Arithm = &ArithmExpr[UpdateRung->Element[x][y].VarNum];
 
-    StateElement = EvalCompare(ArithmExpr[UpdateRung->Element[x][y].VarNum].Expr);
+    StateElement = ExecArithmCode(Arithm->Code, atomic_load_explicit(&Arithm->NbrOps, memory_order_acquire));
     UpdateRung->Element[x][y].DynamicState = StateElement;
     if (x==2)
     {
@@ -686,103 +737,120 @@ char CalcTypeOutputOperate(int x,int y,StrRung * UpdateRung)
     char State;
     State = StateOnLeft(x-2,y,UpdateRung);
     if (State)
-        MakeCalc(ArithmExpr[UpdateRung->Element[x][y].VarNum].Expr,FALSE /* verify mode */);
+    {
+        StrArithmExpr * Arithm = &ArithmExpr[UpdateRung->Element[x][y].VarNum];
+        ExecArithmCode(Arithm->Code, atomic_load_explicit(&Arithm->NbrOps, memory_order_acquire));
+    }
     UpdateRung->Element[x][y].DynamicInput = State;
     UpdateRung->Element[x][y].DynamicState = State;
     return State;
 }
 
 
-int RefreshRung(StrRung * Rung, int * JumpTo)
+/* Refresh one cell of the rung, return the rung to jump to (or -1) */
+int RefreshCell(int x, int y, StrRung * Rung)
 {
-	int x = 0, y = 0;
 	int JumpToRung = -1;
 	int SectionToCall = -1;
 
-	do
+	switch(Rung->Element[x][y].Type)
 	{
-		do
-		{
-			switch(Rung->Element[x][y].Type)
-			{
-				/* MLD,16/5/2001,V0.2.8 , fixed for drawing */
-				case ELE_FREE:
-				case ELE_UNUSABLE:
-					if (StateOnLeft(x,y,Rung))
-						Rung->Element[x][y].DynamicInput = 1;
-					else
-						Rung->Element[x][y].DynamicInput = 0;
-					break;
-				/* End fix */
-				case ELE_INPUT:
-					CalcTypeInput(x,y,Rung,FALSE,FALSE);
-					break;
-				case ELE_INPUT_NOT:
-					CalcTypeInput(x,y,Rung,TRUE,FALSE);
-					break;
-				case ELE_RISING_INPUT:
-					CalcTypeInput(x,y,Rung,FALSE,TRUE);
-					break;
-				case ELE_FALLING_INPUT:
-					CalcTypeInput(x,y,Rung,TRUE,TRUE);
-					break;
-				case ELE_CONNECTION:
-					CalcTypeConnection(x,y,Rung);
-					break;
+		/* MLD,16/5/2001,V0.2.8 , fixed for drawing */
+		case ELE_FREE:
+		case ELE_UNUSABLE:
+			if (StateOnLeft(x,y,Rung))
+				Rung->Element[x][y].DynamicInput = 1;
+			else
+				Rung->Element[x][y].DynamicInput = 0;
+			break;
+		/* End fix */
+		case ELE_INPUT:
+			CalcTypeInput(x,y,Rung,FALSE,FALSE);
+			break;
+		case ELE_INPUT_NOT:
+			CalcTypeInput(x,y,Rung,TRUE,FALSE);
+			break;
+		case ELE_RISING_INPUT:
+			CalcTypeInput(x,y,Rung,FALSE,TRUE);
+			break;
+		case ELE_FALLING_INPUT:
+			CalcTypeInput(x,y,Rung,TRUE,TRUE);
+			break;
+		case ELE_CONNECTION:
+			CalcTypeConnection(x,y,Rung);
+			break;
 #ifdef OLD_TIMERS_MONOS_SUPPORT
-				case ELE_TIMER:
-					CalcTypeTimer(x,y,Rung);
-					break;
-				case ELE_MONOSTABLE:
-					CalcTypeMonostable(x,y,Rung);
-					break;
+		case ELE_TIMER:
+			CalcTypeTimer(x,y,Rung);
+			break;
+		case ELE_MONOSTABLE:
+			CalcTypeMonostable(x,y,Rung);
+			break;
 #endif
-				case ELE_COUNTER:
-					CalcTypeCounter(x,y,Rung);
-					break;
-				case ELE_TIMER_IEC:
-					CalcTypeTimerIEC(x,y,Rung);
-					break;
-				case ELE_COMPAR:
-					CalcTypeCompar(x,y,Rung);
-					break;
-				case ELE_OUTPUT:
-					CalcTypeOutput(x,y,Rung,FALSE);
-					break;
-				case ELE_OUTPUT_NOT:
-					CalcTypeOutput(x,y,Rung,TRUE);
-					break;
-				case ELE_OUTPUT_SET:
-					CalcTypeOutputSetReset(x,y,Rung,FALSE);
-					break;
-				case ELE_OUTPUT_RESET:
-					CalcTypeOutputSetReset(x,y,Rung,TRUE);
-					break;
-				case ELE_OUTPUT_JUMP:
-					JumpToRung = CalcTypeOutputJump(x,y,Rung);
-					// we will now abort the refresh of the rung immediately...
-					break;
-				case ELE_OUTPUT_CALL:
-					SectionToCall = CalcTypeOutputCall(x,y,Rung);
-					if ( SectionToCall!=-1 )
-					{
-						StrSection * pSubRoutineSection = &SectionArray[ SectionToCall ];
-						if ( pSubRoutineSection->Used && pSubRoutineSection->SubRoutineNumber>=0 )
-							RefreshASection( pSubRoutineSection ); //recursive call! ;-)
-						else
-							debug_printf("Refresh rungs aborted - call to a sub-routine undefined or programmed as main !!!");
-					}
-					break;
-				case ELE_OUTPUT_OPERATE:
-					CalcTypeOutputOperate(x,y,Rung);
-					break;
+		case ELE_COUNTER:
+			CalcTypeCounter(x,y,Rung);
+			break;
+		case ELE_TIMER_IEC:
+			CalcTypeTimerIEC(x,y,Rung);
+			break;
+		case ELE_COMPAR:
+			CalcTypeCompar(x,y,Rung);
+			break;
+		case ELE_OUTPUT:
+			CalcTypeOutput(x,y,Rung,FALSE);
+			break;
+		case ELE_OUTPUT_NOT:
+			CalcTypeOutput(x,y,Rung,TRUE);
+			break;
+		case ELE_OUTPUT_SET:
+			CalcTypeOutputSetReset(x,y,Rung,FALSE);
+			break;
+		case ELE_OUTPUT_RESET:
+			CalcTypeOutputSetReset(x,y,Rung,TRUE);
+			break;
+		case ELE_OUTPUT_JUMP:
+			JumpToRung = CalcTypeOutputJump(x,y,Rung);
+			// we will now abort the refresh of the rung immediately...
+			break;
+		case ELE_OUTPUT_CALL:
+			SectionToCall = CalcTypeOutputCall(x,y,Rung);
+			if ( SectionToCall!=-1 )
+			{
+				StrSection * pSubRoutineSection = &SectionArray[ SectionToCall ];
+				if ( pSubRoutineSection->Used && pSubRoutineSection->SubRoutineNumber>=0 )
+					RefreshASection( pSubRoutineSection ); //recursive call! ;-)
+				else
+					debug_printf("Refresh rungs aborted - call to a sub-routine undefined or programmed as main !!!");
 			}
-			y++;
-		}while( y<RUNG_HEIGHT && JumpToRung==-1 );
-		y = 0;
-		x++;
+			break;
+		case ELE_OUTPUT_OPERATE:
+			CalcTypeOutputOperate(x,y,Rung);
+			break;
+	}
+	return JumpToRung;
+}
+
+int RefreshRung(StrRung * Rung, int * JumpTo)
+{
+	int JumpToRung = -1;
+	int NbrCells = atomic_load_explicit( &Rung->NbrCellsPlan, memory_order_acquire );
+	int Scan;
+	int Cell;
+
+	if ( NbrCells<0 )
+	{
+		/* no plan: the whole grid, column per column */
+		for( Cell=0; Cell<RUNG_WIDTH*RUNG_HEIGHT && JumpToRung==-1; Cell++ )
+			JumpToRung = RefreshCell( Cell/RUNG_HEIGHT, Cell%RUNG_HEIGHT, Rung );
+	}
+	else
+	{
+		for( Scan=0; Scan<NbrCells && JumpToRung==-1; Scan++ )
+		{
+			Cell = Rung->CellsPlan[ Scan ];
+			JumpToRung = RefreshCell( Cell/RUNG_HEIGHT, Cell%RUNG_HEIGHT, Rung );
+		}
 	}
-	while( x<RUNG_WIDTH && JumpToRung==-1 );
 
 	*JumpTo = JumpToRung;
 	return TRUE;
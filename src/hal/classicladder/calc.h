@@ -26,6 +26,8 @@ void InitTimersIEC(void);
 void PrepareTimersIEC(void);
 void PrepareAllDatasBeforeRun(void);
 void InitArithmExpr(void);
+void PrepareArithmExpr(void);
+void PlanRung(StrRung * Rung);
 void InitIOConf( void );
 int ReadVarForElement( StrElement * pElem );
 void WriteVarForElement( StrElement *pElem, int Value );
@@ -98,6 +98,9 @@ typedef struct plc_sizeinfo_s {
 #define NBR_ERROR_BITS 	       InfosGene->GeneralParams.SizesInfos.nbr_error_bits
 
 #define ARITHM_EXPR_SIZE 50
+/* ops of a compiled expression: each one eats at least one char of the */
+/* expression text, plus the final compare or store */
+#define ARITHM_CODE_SIZE (ARITHM_EXPR_SIZE+1)
 
 #ifdef MAT_CONNECTION
 #define TYPE_FOR_BOOL_VAR plc_pt_t
@@ -243,6 +246,10 @@ typedef struct StrRung
 	char Label[LGT_LABEL];
 	char Comment[LGT_COMMENT];
 	StrElement Element[RUNG_WIDTH][RUNG_HEIGHT];
+	/* cells really to refresh (x*RUNG_HEIGHT+y), in the grid order, */
+	/* made by PlanRung(). -1 : not done, refresh the whole grid */
+	short NbrCellsPlan;
+	unsigned char CellsPlan[RUNG_WIDTH*RUNG_HEIGHT];
 }StrRung;
 
 #ifdef OLD_TIMERS_MONOS_SUPPORT
@@ -299,9 +306,23 @@ typedef struct StrTimerIEC
 	int ValueToReachOneBaseUnit;
 }StrTimerIEC;
 
+typedef struct StrArithmOp
+{
+	char Op;
+	char Arg;	/* compare flags or number of vars of a function */
+	short VarType;
+	int Value;	/* constant or var offset */
+	short IndexVarType;	/* -1 if var not indexed */
+	int IndexVarOffset;
+}StrArithmOp;
+
 typedef struct StrArithmExpr
 {
 	char Expr[ARITHM_EXPR_SIZE];
+	/* Expr compiled when loaded/applied, executed by the refresh */
+	/* (0 if empty or invalid: nothing to do) */
+	int NbrOps;
+	StrArithmOp Code[ARITHM_CODE_SIZE];
 }StrArithmExpr;
 
 #define DEVICE_TYPE_NONE -1 //added in 0.9.4 because now we can have DEVICE_TYPE_DIRECT_CONFIG and FirstClassicLadderIO at -1 !!!
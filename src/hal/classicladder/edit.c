@@ -598,7 +598,12 @@ void ApplyNewArithmExpr()
 {
 	int NumExpr;
 	for (NumExpr=0; NumExpr<NBR_ARITHM_EXPR; NumExpr++)
+	{
+		/* old code not valid anymore, compiled again with PrepareArithmExpr() */
+		if ( strcmp(ArithmExpr[NumExpr].Expr,EditArithmExpr[NumExpr].Expr)!=0 )
+			ArithmExpr[NumExpr].NbrOps = 0;
 		rtapi_strxcpy(ArithmExpr[NumExpr].Expr,EditArithmExpr[NumExpr].Expr);
+	}
 }
 void CheckForFreeingArithmExpr(int PosiX,int PosiY)
 {
@@ -875,6 +880,7 @@ RedrawSignalDrawingArea( );
 				if ( (RungArray[OldCurrent].Element[x][y].Type == ELE_COMPAR)
 				|| (RungArray[OldCurrent].Element[x][y].Type == ELE_OUTPUT_OPERATE) )
 				{
+					ArithmExpr[ RungArray[OldCurrent].Element[x][y].VarNum ].NbrOps = 0;
 					rtapi_strxcpy(ArithmExpr[ RungArray[OldCurrent].Element[x][y].VarNum ].Expr,"");
 				}
 			}
@@ -899,8 +905,10 @@ void ApplyRungEdited()
 	int PrevNew;
 	int NextNew;
 	save_label_comment_edited();
+	PlanRung(&EditDatas.Rung);
 	CopyRungToRung(&EditDatas.Rung,&RungArray[EditDatas.NumRung]);
 	ApplyNewArithmExpr();
+	PrepareArithmExpr();
 
 	/* if we have added or inserted, we will have to */
 	/* modify the links between rungs */
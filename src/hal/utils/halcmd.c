@@ -87,6 +87,8 @@ int hal_flag = 0;	/* used to indicate that halcmd might have the
 int halcmd_done = 0;		/* used to break out of processing loop */
 int scriptmode = 0;	/* used to make output "script friendly" (suppress headers) */
 int echo_mode = 0;
+int halcmd_parallel = 0;	/* don't wait for 'loadusr -W' until needed */
+int halcmd_profile = 0;	/* time each command, see halcmd_profile_report() */
 char comp_name[HAL_NAME_LEN+1];	/* name for this instance of halcmd */
 
 static void quit(int);
@@ -140,7 +142,7 @@ struct halcmd_command halcmd_commands[] = {
     {"delf",    FUNCT(do_delf_cmd),    A_TWO | A_OPTIONAL },
     {"delsig",  FUNCT(do_delsig_cmd),  A_ONE },
     {"debug",   FUNCT(do_set_debug_cmd),A_ONE },
-    {"echo",    FUNCT(do_echo_cmd),    A_ZERO },
+    {"echo",    FUNCT(do_echo_cmd),    A_ZERO | A_NOWAIT },
     {"getp",    FUNCT(do_getp_cmd),    A_ONE },
     {"gets",    FUNCT(do_gets_cmd),    A_ONE },
     {"print",   FUNCT(do_print_cmd),   A_ONE | A_OPTIONAL},
@@ -151,8 +153,8 @@ struct halcmd_command halcmd_commands[] = {
     {"linkps",  FUNCT(do_linkps_cmd),  A_TWO | A_REMOVE_ARROWS },
     {"linksp",  FUNCT(do_linksp_cmd),  A_TWO | A_REMOVE_ARROWS },
     {"list",    FUNCT(do_list_cmd),    A_ONE | A_PLUS },
-    {"loadrt",  FUNCT(do_loadrt_cmd),  A_ONE | A_PLUS },
-    {"loadusr", FUNCT(do_loadusr_cmd), A_PLUS | A_TILDE },
+    {"loadrt",  FUNCT(do_loadrt_cmd),  A_ONE | A_PLUS | A_NOWAIT },
+    {"loadusr", FUNCT(do_loadusr_cmd), A_PLUS | A_TILDE | A_NOWAIT },
     {"lock",    FUNCT(do_lock_cmd),    A_ONE | A_OPTIONAL },
     {"net",     FUNCT(do_net_cmd),     A_ONE | A_PLUS | A_REMOVE_ARROWS },
     {"newsig",  FUNCT(do_newsig_cmd),  A_TWO },
@@ -161,12 +163,12 @@ struct halcmd_command halcmd_commands[] = {
     {"setp",    FUNCT(do_setp_cmd),    A_TWO },
     {"sets",    FUNCT(do_sets_cmd),    A_TWO },
     {"show",    FUNCT(do_show_cmd),    A_ONE | A_OPTIONAL | A_PLUS},
-    {"source",  FUNCT(do_source_cmd),  A_ONE | A_TILDE },
+    {"source",  FUNCT(do_source_cmd),  A_ONE | A_TILDE | A_NOWAIT },
     {"start",   FUNCT(do_start_cmd),   A_ZERO},
     {"status",  FUNCT(do_status_cmd),  A_ONE | A_OPTIONAL },
     {"stop",    FUNCT(do_stop_cmd),    A_ZERO},
     {"unalias", FUNCT(do_unalias_cmd), A_TWO },
-    {"unecho",  FUNCT(do_unecho_cmd),  A_ZERO },
+    {"unecho",  FUNCT(do_unecho_cmd),  A_ZERO | A_NOWAIT },
     {"unlinkp", FUNCT(do_unlinkp_cmd), A_ONE },
     {"unload",  FUNCT(do_unload_cmd),  A_ONE },
     {"unloadrt", FUNCT(do_unloadrt_cmd), A_ONE },
@@ -313,6 +315,13 @@ static int parse_cmd1(char **argv) {
     if(argc == 0)
         return 0;
 
+    /* anything but loading more programs may depend on the pins of
+       components started by 'loadusr -W' in parallel mode */
+    if(halcmd_pending_waits() && !(command && (command->type & A_NOWAIT))) {
+        if(halcmd_finish_waits() != 0)
+            return -1;
+    }
+
     if(!command) {
 	// special case: pin/param = newvalue
 	if(argc == 3 && !strcmp(argv[1], "=")) {
@@ -444,6 +453,112 @@ static int parse_cmd1(char **argv) {
     }
 }
 
+/* Startup profiling.  Each command run while halcmd_profile is set
+   gets an entry recording where it came from and how long it took.
+   Time spent waiting for a component started by 'loadusr -W' in
+   parallel mode is charged to that loadusr, not to whichever later
+   command happened to need it.
+*/
+struct profile_entry {
+    char *where;
+    char *what;
+    int depth;
+    double elapsed;
+    double waited;
+};
+
+static struct profile_entry *profile;
+static int profile_count, profile_alloc;
+static int profile_current = -1, profile_depth;
+static double profile_start, profile_waited_total;
+
+static double profile_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int profile_add(char *tokens[]) {
+    char where[256], what[64];
+    int i, n = 0;
+
+    if(profile_count == profile_alloc) {
+        int new_alloc = profile_alloc ? 2 * profile_alloc : 64;
+        struct profile_entry *p =
+            realloc(profile, new_alloc * sizeof(struct profile_entry));
+        if(!p) return -1;
+        profile = p;
+        profile_alloc = new_alloc;
+    }
+    snprintf(where, sizeof(where), "%s:%d",
+        halcmd_get_filename(), halcmd_get_linenumber());
+    what[0] = 0;
+    for(i=0; tokens[i] && tokens[i][0] && n < (int)sizeof(what); i++) {
+        n += snprintf(what + n, sizeof(what) - n, "%s%s", i ? " " : "",
+            tokens[i]);
+    }
+    profile[profile_count].where = strdup(where);
+    profile[profile_count].what = strdup(what);
+    profile[profile_count].depth = profile_depth;
+    profile[profile_count].elapsed = 0;
+    profile[profile_count].waited = 0;
+    return profile_count++;
+}
+
+int halcmd_profile_entry(void) {
+    return profile_current;
+}
+
+void halcmd_profile_waited(int entry, double seconds) {
+    if(!halcmd_profile) return;
+    profile_waited_total += seconds;
+    if(entry >= 0 && entry < profile_count)
+        profile[entry].waited += seconds;
+}
+
+static int profile_cmd(char *tokens[]) {
+    int retval, entry, parent = profile_current;
+    double start, waited_before;
+
+    if(profile_count == 0) profile_start = profile_now();
+    entry = profile_add(tokens);
+    profile_current = entry;
+    profile_depth++;
+    waited_before = profile_waited_total;
+    start = profile_now();
+
+    hal_flag = 1;
+    retval = parse_cmd1(tokens);
+    hal_flag = 0;
+
+    if(entry >= 0) {
+        profile[entry].elapsed = profile_now() - start
+            - (profile_waited_total - waited_before);
+    }
+    profile_depth--;
+    profile_current = parent;
+    return retval;
+}
+
+void halcmd_profile_report(void) {
+    int i;
+    double total = 0;
+
+    if(!halcmd_profile || profile_count == 0) return;
+    fprintf(stderr, "%10s %10s  %-30s %s\n",
+        "time(ms)", "wait(ms)", "location", "command");
+    for(i=0; i<profile_count; i++) {
+        struct profile_entry *p = &profile[i];
+        fprintf(stderr, "%10.1f %10.1f  %-30s %*s%s\n",
+            p->elapsed * 1e3, p->waited * 1e3, p->where,
+            2 * p->depth, "", p->what);
+        total += p->waited;
+        if(p->depth == 0) total += p->elapsed;
+    }
+    fprintf(stderr, "%d commands, %.1f ms in commands, %.1f ms total\n",
+        profile_count, total * 1e3, (profile_now() - profile_start) * 1e3);
+}
+
 int halcmd_parse_cmd(char *tokens[])
 {
     int retval;
@@ -456,6 +571,10 @@ int halcmd_parse_cmd(char *tokens[])
         first_time = 0;
     }
 
+    if(halcmd_profile) {
+        return profile_cmd(tokens);
+    }
+
     hal_flag = 1;
     retval = parse_cmd1(tokens);
     hal_flag = 0;
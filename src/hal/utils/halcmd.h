@@ -51,6 +51,12 @@ extern int halcmd_parse_line(char * line);
 extern void halcmd_shutdown(void);
 extern int prompt_mode, echo_mode, errorcount, halcmd_done;
 extern int halcmd_preprocess_line ( char *line, char **tokens);
+extern int halcmd_parallel, halcmd_profile;
+
+/* per-command timing, collected when halcmd_profile is set */
+int halcmd_profile_entry(void);
+void halcmd_profile_waited(int entry, double seconds);
+void halcmd_profile_report(void);
 
 void halcmd_info(const char *format,...) __attribute__((format(printf,1,2)));
 void halcmd_output(const char *format,...) __attribute__((format(printf,1,2)));
@@ -74,6 +80,7 @@ enum halcmd_argtype {
     A_REMOVE_ARROWS = 0x200, /* removes any arrows from command */
     A_OPTIONAL = 0x400,      /* arguments may be NULL */
     A_TILDE = 0x800,         /* tilde-expand all arguments */
+    A_NOWAIT = 0x1000,       /* need not wait for pending 'loadusr -W' */
 };
 
 typedef int(*halcmd_func_t)(void);
@@ -59,6 +59,7 @@
 
 
 static int unloadrt_comp(char *mod_name);
+static int loadusr(const char *args[], int may_defer);
 static void print_comp_info(char **patterns);
 static void print_pin_info(int type, char **patterns);
 static void print_pin_aliases(char **patterns);
@@ -1105,7 +1106,8 @@ int do_loadrt_cmd(char *mod_name, char *args[])
         argv[m++] = args[n++];
     }
     argv[m++] = NULL;
-    retval = do_loadusr_cmd(argv);
+    /* realtime modules are always loaded one at a time, in order */
+    retval = loadusr(argv, 0);
 #else
     static char *rtmod_dir = EMC2_RTLIB_DIR;
     struct stat stat_buf;
@@ -1444,6 +1446,26 @@ is not fixed or has regressed by debian jessie)
 
 #include <set>
 #include <string>
+#include <vector>
+
+/* a 'loadusr -W' program that was started but whose component has not
+   yet been seen to become ready (see halcmd -P) */
+struct pending_wait {
+    pid_t pid;
+    std::string prog_name;
+    std::string comp_name;
+    std::set<std::string> comp_names_pre;
+    int profile_entry;
+};
+
+static std::vector<pending_wait> pending_waits;
+
+static bool is_pending(const std::string &name) {
+    for(const auto &w : pending_waits) {
+        if(w.comp_name == name) return true;
+    }
+    return false;
+}
 
 static std::set<std::string> get_all_comp_names() {
     std::set<std::string> result;
@@ -1457,6 +1479,8 @@ static void warn_newly_loaded_comps(std::set<std::string> &names, const char *ne
     auto new_names = get_all_comp_names();
     for(const auto &name : new_names) {
         if(name == newname) continue;
+        /* programs started in parallel are expected to show up */
+        if(is_pending(name)) continue;
         if(names.find(name) == names.end()) {
             fprintf(stderr, "\nWhile waiting for '%s', component '%s' loaded.\nDid you specify the correct name via 'loadusr -Wn'?", newname, name.c_str());
         }
@@ -1464,7 +1488,100 @@ static void warn_newly_loaded_comps(std::set<std::string> &names, const char *ne
     std::swap(new_names, names);
 }
 
-int do_loadusr_cmd(const char *args[])
+static double monotonic_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* wait until the component started by 'w' becomes ready, or the
+   program exits.  The HAL is polled at a short interval at first, so
+   that quick programs (such as rtapi_app doing a loadrt) don't each
+   cost a full 10mS sleep, backing off to 10mS for slow starters. */
+static int wait_comp_ready(pending_wait &w)
+{
+    int ready = 0, exited = 0, pacified = 0, retval = 0, status;
+    long delay_ns = 500 * 1000;
+    double start = monotonic_time(), next_dot = start + 2.0;
+    hal_comp_t *comp = NULL;
+
+    while(1) {
+	/* check for program becoming ready */
+	rtapi_mutex_get(&(hal_data->mutex));
+	comp = halpr_find_comp_by_name(w.comp_name.c_str());
+	if(comp && comp->ready) {
+	    ready = 1;
+	}
+	rtapi_mutex_give(&(hal_data->mutex));
+	if(ready || exited) break;
+	/* check for program ending */
+	retval = waitpid( w.pid, &status, WNOHANG );
+	if ( retval != 0 ) {
+	    exited = 1;
+	    if (retval > 0 && WIFEXITED(status) && WEXITSTATUS(status)) {
+		halcmd_error("waitpid failed %s %s\n",
+		    w.prog_name.c_str(), w.comp_name.c_str());
+		break;
+	    }
+	    /* look for the component one last time */
+	    continue;
+	}
+	/* pacify the user */
+	double now = monotonic_time();
+	if(now >= next_dot) {
+	    if(!pacified) {
+		fprintf(stderr, "Waiting for component '%s' to become ready.",
+			w.comp_name.c_str());
+		pacified = 1;
+	    } else {
+		fprintf(stderr, ".");
+	    }
+	    warn_newly_loaded_comps(w.comp_names_pre, w.comp_name.c_str());
+	    fflush(stderr);
+	    next_dot = now + 0.1;
+	}
+	struct timespec ts = {0, delay_ns};
+	nanosleep(&ts, NULL);
+	if(delay_ns < 10 * 1000 * 1000) delay_ns *= 2;
+	if(delay_ns > 10 * 1000 * 1000) delay_ns = 10 * 1000 * 1000;
+    }
+    if (pacified) {
+	/* terminate pacifier */
+	fprintf(stderr, "\n");
+    }
+    halcmd_profile_waited(w.profile_entry, monotonic_time() - start);
+    /* did it work? */
+    if (ready) {
+	halcmd_info("Component '%s' ready\n", w.comp_name.c_str());
+	return 0;
+    }
+    if ( retval < 0 ) {
+	halcmd_error("\nwaitpid(%d) failed\n", w.pid);
+    } else {
+	halcmd_error("%s exited without becoming ready\n", w.prog_name.c_str());
+    }
+    return -1;
+}
+
+int halcmd_pending_waits(void)
+{
+    return pending_waits.size();
+}
+
+int halcmd_finish_waits(void)
+{
+    int result = 0;
+    /* the programs are all running already, so waiting for them one
+       after the other takes as long as the slowest of them */
+    while(!pending_waits.empty()) {
+	pending_wait w = pending_waits.front();
+	pending_waits.erase(pending_waits.begin());
+	if(wait_comp_ready(w) != 0) result = -1;
+    }
+    return result;
+}
+
+static int loadusr(const char *args[], int may_defer)
 {
     int wait_flag, wait_comp_flag, ignore_flag;
     const char *prog_name, *new_comp_name=NULL;
@@ -1512,6 +1629,11 @@ int do_loadusr_cmd(const char *args[])
     if(!new_comp_name) {
 	new_comp_name = guess_comp_name(prog_name);
     }
+    if(wait_comp_flag && is_pending(new_comp_name)) {
+	halcmd_error("already waiting for a component named '%s'\n",
+	    new_comp_name);
+	return -EINVAL;
+    }
 
     std::set<std::string> comp_names_pre = get_all_comp_names();
 
@@ -1535,56 +1657,16 @@ int do_loadusr_cmd(const char *args[])
     }
     hal_ready(comp_id);
     if ( wait_comp_flag ) {
-        int ready = 0, count=0, exited=0;
-        hal_comp_t *comp = NULL;
-	retval = 0;
-        while(!ready && !exited) {
-	    /* sleep for 10mS */
-            struct timespec ts = {0, 10 * 1000 * 1000};
-            nanosleep(&ts, NULL);
-	    /* check for program ending */
-	    retval = waitpid( pid, &status, WNOHANG );
-	    if ( retval != 0 ) {
-		    exited = 1;
-	        if (WIFEXITED(status) && WEXITSTATUS(status)) {
-	            halcmd_error("waitpid failed %s %s\n",prog_name,new_comp_name);
-	            ready = 0;
-	            break;
-	        }
-	    }
-	    /* check for program becoming ready */
-            rtapi_mutex_get(&(hal_data->mutex));
-            comp = halpr_find_comp_by_name(new_comp_name);
-            if(comp && comp->ready) {
-                ready = 1;
-            }
-            rtapi_mutex_give(&(hal_data->mutex));
-	    /* pacify the user */
-            count++;
-            if(count == 200) {
-                fprintf(stderr, "Waiting for component '%s' to become ready.",
-                        new_comp_name);
-                warn_newly_loaded_comps(comp_names_pre, new_comp_name);
-                fflush(stderr);
-            } else if(count > 200 && count % 10 == 0) {
-                fprintf(stderr, ".");
-                warn_newly_loaded_comps(comp_names_pre, new_comp_name);
-                fflush(stderr);
-            }
-        }
-        if (count >= 100) {
-	    /* terminate pacifier */
-	    fprintf(stderr, "\n");
+	pending_wait w{pid, prog_name, new_comp_name,
+	    std::move(comp_names_pre), halcmd_profile_entry()};
+	if ( may_defer && !wait_flag ) {
+	    /* halcmd -P: let it come up while the next commands run */
+	    pending_waits.push_back(std::move(w));
+	    halcmd_info("Program '%s' started, component '%s' pending\n",
+		prog_name, new_comp_name);
+	    return 0;
 	}
-	/* did it work? */
-	if (ready) {
-	    halcmd_info("Component '%s' ready\n", new_comp_name);
-	} else {
-	    if ( retval < 0 ) {
-		halcmd_error("\nwaitpid(%d) failed\n", pid);
-	    } else {
-		halcmd_error("%s exited without becoming ready\n", prog_name);
-	    }
+	if ( wait_comp_ready(w) != 0 ) {
 	    return -1;
 	}
     }
@@ -1616,6 +1698,10 @@ int do_loadusr_cmd(const char *args[])
     return 0;
 }
 
+int do_loadusr_cmd(const char *args[])
+{
+    return loadusr(args, halcmd_parallel);
+}
 
 int do_waitusr_cmd(char *comp_name)
 {
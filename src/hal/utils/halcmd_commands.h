@@ -90,6 +90,12 @@ extern int do_setexact_cmd(void);
 pid_t hal_systemv_nowait(const char *const argv[]);
 int hal_systemv(const char *const argv[]);
 
+/* number of 'loadusr -W' components started by halcmd -P that have
+   not yet been waited for */
+extern int halcmd_pending_waits(void);
+/* wait for all of them; nonzero if any failed to become ready */
+extern int halcmd_finish_waits(void);
+
 extern int scriptmode, comp_id;
 
 RTAPI_END_DECLS
@@ -113,7 +113,7 @@ int main(int argc, char **argv)
     keep_going = 0;
     /* start parsing the command line, options first */
     while(1) {
-        c = getopt(argc, argv, "+RCfi:kqQsvVhe");
+        c = getopt(argc, argv, "+RCfi:kPqQsTvVhe");
         if(c == -1) break;
         switch(c) {
             case 'R':
@@ -137,6 +137,14 @@ int main(int argc, char **argv)
 		/* -k = keep going */
 		keep_going = 1;
 		break;
+	    case 'P':
+		/* -P = parallel 'loadusr -W' */
+		halcmd_parallel = 1;
+		break;
+	    case 'T':
+		/* -T = print command timing */
+		halcmd_profile = 1;
+		break;
 	    case 'q':
 		/* -q = quiet (default) */
 		rtapi_set_msg_level(RTAPI_MSG_ERR);
@@ -331,6 +339,11 @@ int main(int argc, char **argv)
 	} //while get_input()
         extend_ct=0;
     }
+    /* programs started by 'loadusr -W' must be ready before we exit */
+    if ( halcmd_finish_waits() != 0 ) {
+        errorcount++;
+    }
+    halcmd_profile_report();
     /* all done */
     halcmd_shutdown();
     if ( errorcount > 0 ) {
@@ -419,12 +432,15 @@ static void print_help_general(int showR)
 #endif
     printf("  -k             Keep going after failed command.  Default\n");
     printf("                 is to exit if any command fails. (Useful with -f)\n");
+    printf("  -P             Parallel - start further 'loadusr -W' programs\n");
+    printf("                 before earlier ones are ready.\n");
     printf("  -q             Quiet - print errors only (default).\n");
     printf("  -Q             Very quiet - print nothing.\n");
     if (showR != 0) {
     printf("  -R             Release mutex (for crash recovery only).\n");
     }
     printf("  -s             Script friendly - don't print headers on output.\n");
+    printf("  -T             Timing - print how long each command took.\n");
     printf("  -v             Verbose - print result of every command.\n");
     printf("  -V             Very verbose - print lots of junk.\n");
     printf("  -h             Help - print this help screen and exit.\n\n");
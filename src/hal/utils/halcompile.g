@@ -114,6 +114,11 @@ MAX_PERSONALITIES = 64
 
 mp_decl_map = {'int': 'RTAPI_MP_INT', 'dummy': None}
 
+# plain (non-volatile) C types for the pin arrays of 'option vectorize';
+# bits are kept as bytes because gcc will not vectorize loads of bool
+vecmap = {'bit': 'rtapi_u8', 'float': 'real_t', 'u32': 'rtapi_u32',
+    's32': 'rtapi_s32', 'u64': 'rtapi_u64', 's64': 'rtapi_s64'}
+
 # These are symbols that comp puts in the global namespace of the C file it
 # creates.  The user is thus not allowed to add any symbols with these
 # names.  That includes not only global variables and functions, but also
@@ -366,9 +371,23 @@ static int comp_id;
     for name, fp in functions:
         if name in names:
             Error("Duplicate item name: %s" % name)
-        print("static void %s(struct __comp_state *__comp_inst, long period);" % to_c(name), file=f)
+        if options.get("vectorize"):
+            print("static inline void %s(int __i, struct __comp_state *__comp_inst, long period);" % to_c(name), file=f)
+        else:
+            print("static void %s(struct __comp_state *__comp_inst, long period);" % to_c(name), file=f)
         names[name] = 1
 
+    if options.get("vectorize"):
+        # one contiguous array per pin and plain param, refilled from all
+        # instances each time the funct runs
+        print("static int __comp_vec_count;", file=f)
+        print("static struct __comp_state **__comp_vec_inst;", file=f)
+        for name, type, array, dir, value, personality in pins:
+            print("static %s *__comp_vec_%s;" % (vecmap[type], to_c(name)), file=f)
+        for name, type, array, dir, value, personality in vectorized_params():
+            print("static %s *__comp_vec_%s, *__comp_vec_%s_0;" % (vecmap[type], to_c(name), to_c(name)), file=f)
+        print("static int __comp_vectorize(void);", file=f)
+
     print("static int __comp_get_data_size(void);", file=f)
     if options.get("extra_setup"):
         print("static int extra_setup(struct __comp_state *__comp_inst, char *prefix, long extra_arg);", file=f)
@@ -390,7 +409,7 @@ static int comp_id;
         print("static int export(char *prefix, long extra_arg, long personality) {", file=f)
     else:
         print("static int export(char *prefix, long extra_arg) {", file=f)
-    if len(functions) > 0:
+    if len(functions) > 0 and not options.get("vectorize"):
         print("    char buf[HAL_NAME_LEN + 1];", file=f)
     print("    int r = 0;", file=f)
     if has_array:
@@ -480,6 +499,7 @@ static int comp_id;
             print("    inst->%s_p = %s;" % (name, value), file=f)
 
     for name, fp in functions:
+        if options.get("vectorize"): break
         print("    rtapi_snprintf(buf, sizeof(buf), \"%%s%s\", prefix);"\
             % to_hal("." + name), file=f)
         print("    r = hal_export_funct(buf, (void(*)(void *inst, long))%s, inst, %s, 0, comp_id);" % (
@@ -625,6 +645,8 @@ static int comp_id;
                 print("        }", file=f)
                 print("    }", file=f)
 
+        if options.get("vectorize"):
+            print("    if(r == 0) r = __comp_vectorize();", file=f)
         if options.get("constructable") and not options.get("singleton"):
             print("    hal_set_constructor(comp_id, export_1);", file=f)
         print("    if(r) {", file=f)
@@ -718,7 +740,10 @@ int __comp_parse_names(int *argc, char **argv) {
     print("", file=f)
     if not options.get("no_convenience_defines"):
         print("#undef FUNCTION", file=f)
-        print("#define FUNCTION(name) static void name(struct __comp_state *__comp_inst, long period)", file=f)
+        if options.get("vectorize"):
+            print("#define FUNCTION(name) static inline void name(int __i, struct __comp_state *__comp_inst, long period)", file=f)
+        else:
+            print("#define FUNCTION(name) static void name(struct __comp_state *__comp_inst, long period)", file=f)
         print("#undef EXTRA_SETUP", file=f)
         print("#define EXTRA_SETUP() static int extra_setup(struct __comp_state *__comp_inst, char *prefix, long extra_arg)", file=f)
         print("#undef EXTRA_CLEANUP", file=f)
@@ -728,7 +753,13 @@ int __comp_parse_names(int *argc, char **argv) {
         for name, type, array, dir, value, personality in pins:
             print("#undef %s" % to_c(name), file=f)
             print("#undef %s_ptr" % to_c(name), file=f)
-            if array:
+            if options.get("vectorize"):
+                # the value gathered for this instance; there is no _ptr
+                if dir == 'in':
+                    print("#define %s (0+__comp_vec_%s[__i])" % (to_c(name), to_c(name)), file=f)
+                else:
+                    print("#define %s (__comp_vec_%s[__i])" % (to_c(name), to_c(name)), file=f)
+            elif array:
                 print("#define %s_ptr(i) (__comp_inst->%s_p[i])" % (to_c(name), to_c(name)), file=f)
                 if dir == 'in':
                     print("#define %s(i) (0+*(__comp_inst->%s_p[i]))" % (to_c(name), to_c(name)), file=f)
@@ -742,7 +773,9 @@ int __comp_parse_names(int *argc, char **argv) {
                     print("#define %s (*__comp_inst->%s_p)" % (to_c(name), to_c(name)), file=f)
         for name, type, array, dir, value, personality in params:
             print("#undef %s" % to_c(name), file=f)
-            if array:
+            if options.get("vectorize") and (name, type, array, dir, value, personality) in vectorized_params():
+                print("#define %s (__comp_vec_%s[__i])" % (to_c(name), to_c(name)), file=f)
+            elif array:
                 print("#define %s(i) (__comp_inst->%s_p[i])" % (to_c(name), to_c(name)), file=f)
             else:
                 print("#define %s (__comp_inst->%s_p)" % (to_c(name), to_c(name)), file=f)
@@ -776,6 +809,74 @@ def epilogue(f):
         print("static int __comp_get_data_size(void) { return sizeof(%s); }" % data, file=f)
     else:
         print("static int __comp_get_data_size(void) { return 0; }", file=f)
+    if options.get("vectorize"):
+        vectorize_epilogue(f)
+
+def vectorized_params():
+    # params that can be gathered like pins; others stay in __comp_inst
+    return [p for p in params if not p[2] and not p[5] and p[1] in vecmap]
+
+def vectorize_epilogue(f):
+    # For each FUNCTION, one funct that runs it for every instance:
+    # gather all pins into the arrays, run the body over the arrays in a
+    # loop the compiler may vectorize, then scatter the outputs back
+    prefix = to_hal(removeprefix(comp_name, "hal_"))
+    for name, fp in functions:
+        print("", file=f)
+        print("static void __comp_vec_funct_%s(void *__arg, long period) {" % to_c(name), file=f)
+        print("    struct __comp_state **__inst = __comp_vec_inst;", file=f)
+        print("    int __i, __n = __comp_vec_count;", file=f)
+        print("    for(__i = 0; __i < __n; __i++) {", file=f)
+        for pname, type, array, dir, value, personality in pins:
+            print("        __comp_vec_%s[__i] = *__inst[__i]->%s_p;" % (to_c(pname), to_c(pname)), file=f)
+        for pname, type, array, dir, value, personality in vectorized_params():
+            print("        __comp_vec_%s[__i] = __comp_vec_%s_0[__i] = __inst[__i]->%s_p;" % (to_c(pname), to_c(pname), to_c(pname)), file=f)
+        print("    }", file=f)
+        print("#ifdef __GNUC__", file=f)
+        print("#pragma GCC ivdep", file=f)
+        print("#endif", file=f)
+        print("    for(__i = 0; __i < __n; __i++) {", file=f)
+        print("        %s(__i, __inst[__i], period);" % to_c(name), file=f)
+        print("    }", file=f)
+        print("    for(__i = 0; __i < __n; __i++) {", file=f)
+        for pname, type, array, dir, value, personality in pins:
+            if dir == 'in': continue
+            print("        *__inst[__i]->%s_p = __comp_vec_%s[__i];" % (to_c(pname), to_c(pname)), file=f)
+        # write back only params the body changed, so as not to undo a
+        # setp that happened meanwhile
+        for pname, type, array, dir, value, personality in vectorized_params():
+            print("        if(__comp_vec_%s[__i] != __comp_vec_%s_0[__i]) __inst[__i]->%s_p = __comp_vec_%s[__i];" % (
+                to_c(pname), to_c(pname), to_c(pname), to_c(pname)), file=f)
+        print("    }", file=f)
+        print("}", file=f)
+
+    print("", file=f)
+    print("static int __comp_vectorize(void) {", file=f)
+    print("    struct __comp_state *__inst;", file=f)
+    print("    int __r, __n = 0;", file=f)
+    print("    for(__inst = __comp_first_inst; __inst; __inst = __inst->_next) __n++;", file=f)
+    print("    if(__n == 0) return 0;", file=f)
+    print("    __comp_vec_count = __n;", file=f)
+    print("    __comp_vec_inst = hal_malloc(__n * sizeof(*__comp_vec_inst));", file=f)
+    print("    if(!__comp_vec_inst) return -ENOMEM;", file=f)
+    print("    __n = 0;", file=f)
+    print("    for(__inst = __comp_first_inst; __inst; __inst = __inst->_next) __comp_vec_inst[__n++] = __inst;", file=f)
+    arrays = [to_c(p[0]) for p in pins]
+    for p in vectorized_params():
+        arrays += [to_c(p[0]), to_c(p[0]) + "_0"]
+    for name in arrays:
+        print("    __comp_vec_%s = hal_malloc(__n * sizeof(*__comp_vec_%s));" % (name, name), file=f)
+        print("    if(!__comp_vec_%s) return -ENOMEM;" % name, file=f)
+    for name, fp in functions:
+        if name == "_":
+            fname = prefix
+        else:
+            fname = prefix + to_hal("." + name)
+        print("    __r = hal_export_funct(\"%s\", __comp_vec_funct_%s, 0, %s, 0, comp_id);" % (
+            fname, to_c(name), int(fp)), file=f)
+        print("    if(__r != 0) return __r;", file=f)
+    print("    return 0;", file=f)
+    print("}", file=f)
 
 INSTALL, COMPILE, PREPROCESS, DOCUMENT, INSTALLDOC, VIEWDOC, MODINC = range(7)
 modename = ("install", "compile", "preprocess", "document", "installdoc", "viewdoc", "print-modinc")
@@ -1079,6 +1180,20 @@ def process(filename, mode, outfilename):
                 raise SystemExit("Userspace components may not have functions")
         if not pins:
             raise SystemExit("Component must have at least one pin")
+        if options.get("vectorize"):
+            if options.get("userspace") or options.get("constructable") \
+                    or options.get("no_convenience_defines") \
+                    or not options.get("rtapi_app", 1):
+                raise SystemExit("option vectorize may not be combined with "
+                    "userspace, constructable, no_convenience_defines or rtapi_app")
+            # the gathered arrays are shared, so two functs of the same
+            # component in different threads would trample each other
+            if len(functions) != 1:
+                raise SystemExit("option vectorize requires exactly one function")
+            for name, type, array, dir, value, personality in pins:
+                if array or personality or type not in vecmap:
+                    raise SystemExit("option vectorize requires pins that "
+                        "are not arrays, not conditional and not ports (%s)" % name)
         prologue(f)
         lineno = a.count("\n") + 3
 
@@ -0,0 +1,559 @@
+/** This file, 'halrecord.c', records HAL pins, signals and parameters
+    to a file without gaps for as long as it runs, using the streaming
+    mode of the halscope realtime component 'scope_rt'.  It needs no
+    GUI, so it can be left running for hours on a machine to catch
+    intermittent faults.
+
+    Invoking:
+
+    halrecord [-t thread] [-m mult] [-n count] [-b size] [-o file] name...
+    halrecord -d [file]
+
+    Each 'name' is a pin, signal or parameter.  Up to
+    SCOPE_MAX_CHANNELS may be recorded at once.  Samples are taken every
+    'mult' periods of 'thread' (default servo-thread), and written to
+    'file' (default stdout) until halrecord is interrupted, or until
+    'count' samples have been written.  If scope_rt is not loaded yet
+    it is loaded with room for 'size' values.
+
+    The file starts with a text header describing the channels,
+    followed by the samples in binary form, so it is compact and can
+    be piped through a compressor.  '-d' reads such a file and prints
+    it as text, one line per sample, marking any place where samples
+    were dropped because halrecord fell behind.
+*/
+
+/** This program is free software; you can redistribute it and/or
+    modify it under the terms of version 2 of the GNU General
+    Public License as published by the Free Software Foundation.
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+    THE AUTHORS OF THIS LIBRARY ACCEPT ABSOLUTELY NO LIABILITY FOR
+    ANY HARM OR LOSS RESULTING FROM ITS USE.  IT IS _EXTREMELY_ UNWISE
+    TO RELY ON SOFTWARE ALONE FOR SAFETY.  Any machinery capable of
+    harming persons must have provisions for completely removing power
+    from all motors, etc, before persons enter any danger area.  All
+    machinery must be designed to comply with local and national safety
+    codes, and the authors of this software can not, and do not, take
+    any responsibility for such compliance.
+
+    This code was written as part of the EMC HAL project.  For more
+    information, go to https://linuxcnc.org.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <inttypes.h>
+
+#include "rtapi.h"		/* RTAPI realtime OS API */
+#include "hal.h"		/* HAL public API decls */
+#include "../hal_priv.h"	/* HAL private API decls */
+#include "rtapi_mutex.h"
+#include "rtapi_atomic.h"
+#include "scope_shm.h"
+
+#define MAGIC "HALRECORD 1\n"
+
+/***********************************************************************
+*                         LOCAL VARIABLES                              *
+************************************************************************/
+
+static int comp_id = -1;
+static int shm_id = -1;
+static scope_shm_control_t *ctrl_shm;
+static scope_data_t *buffer;
+static int attached;		/* scope.sample added to a thread by us */
+static sig_atomic_t stop;
+
+static int num_chans;
+static char *chan_name[SCOPE_MAX_CHANNELS];
+static hal_type_t chan_type[SCOPE_MAX_CHANNELS];
+static int chan_len[SCOPE_MAX_CHANNELS];
+
+/***********************************************************************
+*                        LOCAL FUNCTION CODE                           *
+************************************************************************/
+
+static void quit(int sig)
+{
+    stop = 1;
+}
+
+static const char *type_name(hal_type_t type)
+{
+    switch (type) {
+    case HAL_BIT: return "bit";
+    case HAL_FLOAT: return "float";
+    case HAL_S32: return "s32";
+    case HAL_U32: return "u32";
+    case HAL_S64: return "s64";
+    case HAL_U64: return "u64";
+    default: return NULL;
+    }
+}
+
+static int type_len(hal_type_t type)
+{
+    switch (type) {
+    case HAL_BIT: return 1;
+    case HAL_S32: case HAL_U32: return 4;
+    case HAL_FLOAT: case HAL_S64: case HAL_U64: return 8;
+    default: return 0;
+    }
+}
+
+/* find 'name' as a pin, signal or parameter, and fill in channel 'n'
+   of the scope shared memory.  Called with the HAL mutex held. */
+static int find_source(int n, const char *name)
+{
+    hal_pin_t *pin;
+    hal_sig_t *sig;
+    hal_param_t *param;
+    hal_type_t type;
+    int offset;
+
+    if ((pin = halpr_find_pin_by_name(name)) != NULL) {
+	if (pin->signal == 0) {
+	    /* pin is unlinked, get data from dummysig */
+	    offset = SHMOFF(&(pin->dummysig));
+	} else {
+	    sig = SHMPTR(pin->signal);
+	    offset = sig->data_ptr;
+	}
+	type = pin->type;
+    } else if ((sig = halpr_find_sig_by_name(name)) != NULL) {
+	offset = sig->data_ptr;
+	type = sig->type;
+    } else if ((param = halpr_find_param_by_name(name)) != NULL) {
+	offset = param->data_ptr;
+	type = param->type;
+    } else {
+	fprintf(stderr, "halrecord: no pin, signal or parameter '%s'\n", name);
+	return -1;
+    }
+    if (type_len(type) == 0) {
+	fprintf(stderr, "halrecord: '%s' has a type that can't be recorded\n",
+	    name);
+	return -1;
+    }
+    ctrl_shm->data_offset[n] = offset;
+    ctrl_shm->data_type[n] = type;
+    ctrl_shm->data_len[n] = type_len(type);
+    chan_type[n] = type;
+    chan_len[n] = type_len(type);
+    return 0;
+}
+
+static int connect_scope(long num_samples)
+{
+    void *shm_base;
+    int skip;
+
+    if (!halpr_find_funct_by_name("scope.sample")) {
+	char buf[1000];
+	snprintf(buf, sizeof(buf),
+	    EMC2_BIN_DIR "/halcmd loadrt scope_rt num_samples=%ld",
+	    num_samples);
+	if (system(buf) != 0) {
+	    fprintf(stderr, "halrecord: loadrt scope_rt failed\n");
+	    return -1;
+	}
+    }
+    shm_id = rtapi_shmem_new(SCOPE_SHM_KEY, comp_id,
+	sizeof(scope_shm_control_t));
+    if (shm_id < 0) {
+	fprintf(stderr, "halrecord: failed to get scope shared memory\n");
+	return -1;
+    }
+    if (rtapi_shmem_getptr(shm_id, &shm_base) < 0) {
+	fprintf(stderr, "halrecord: failed to map scope shared memory\n");
+	return -1;
+    }
+    ctrl_shm = shm_base;
+    if (ctrl_shm->shm_size == 0) {
+	fprintf(stderr, "halrecord: realtime component not loaded?\n");
+	return -1;
+    }
+    /* the rest of the shared memory area is the data buffer */
+    skip = (sizeof(scope_shm_control_t) + 3) & ~3;
+    buffer = (scope_data_t *) (((char *) shm_base) + skip);
+    return 0;
+}
+
+static void disconnect_scope(void)
+{
+    int n;
+
+    if (ctrl_shm == NULL) {
+	return;
+    }
+    if (attached) {
+	if (ctrl_shm->state != IDLE) {
+	    ctrl_shm->state = RESET;
+	    /* give the realtime code a chance to acknowledge */
+	    for (n = 0; n < 100 && ctrl_shm->state != IDLE; n++) {
+		usleep(10000);
+	    }
+	}
+	ctrl_shm->stream = 0;
+	hal_del_funct_from_thread("scope.sample", ctrl_shm->thread_name);
+	ctrl_shm->thread_name[0] = '\0';
+	attached = 0;
+    }
+}
+
+static void write_header(FILE *out, const char *thread_name, long period,
+    int mult)
+{
+    int n;
+    unsigned one = 1;
+
+    fputs(MAGIC, out);
+    fprintf(out, "byteorder %s\n",
+	*(unsigned char *) &one ? "little" : "big");
+    fprintf(out, "thread %s %ld %d\n", thread_name, period, mult);
+    fprintf(out, "channels %d\n", num_chans);
+    for (n = 0; n < num_chans; n++) {
+	fprintf(out, "%s %s\n", type_name(chan_type[n]), chan_name[n]);
+    }
+    fputs("data\n", out);
+}
+
+/* Samples are written in blocks of consecutive sample numbers: a u32
+   first sample number and a u32 count, then 'count' samples, each the
+   channel values in order, packed at their natural size.  Every pass
+   over the ring writes at least one block, and a new block starts
+   wherever samples were lost. */
+static int write_run(FILE *out, scope_data_t *first, int count)
+{
+    int n, k, j;
+    scope_data_t *sample;
+    rtapi_u32 hdr[2];
+
+    for (k = 0; k < count; k += hdr[1]) {
+	/* find how many of the samples are consecutive */
+	hdr[0] = first[k * ctrl_shm->sample_len].d_u32;
+	hdr[1] = 1;
+	while (k + hdr[1] < count
+	    && first[(k + hdr[1]) * ctrl_shm->sample_len].d_u32
+		== hdr[0] + hdr[1]) {
+	    hdr[1]++;
+	}
+	if (fwrite(hdr, sizeof(hdr), 1, out) != 1) {
+	    return -1;
+	}
+	for (j = k; j < k + (int) hdr[1]; j++) {
+	    sample = first + j * ctrl_shm->sample_len;
+	    for (n = 0; n < num_chans; n++) {
+		switch (chan_len[n]) {
+		case 1:
+		    fputc(sample[n + 1].d_u8 != 0, out);
+		    break;
+		case 4:
+		    fwrite(&sample[n + 1].d_u32, 4, 1, out);
+		    break;
+		default:
+		    fwrite(&sample[n + 1].d_ireal, 8, 1, out);
+		    break;
+		}
+	    }
+	}
+    }
+    return ferror(out) ? -1 : 0;
+}
+
+static int record(FILE *out, long count)
+{
+    int in, out_idx, len, dog = 0;
+    long written = 0;
+    unsigned long lost_reported = 0;
+
+    len = ctrl_shm->stream_len;
+    while (!stop && (count < 0 || written < count)) {
+	/* check that the realtime code is still running */
+	if (ctrl_shm->watchdog < 100) {
+	    ctrl_shm->watchdog++;
+	    dog = 0;
+	} else if (!dog) {
+	    fprintf(stderr, "halrecord: thread '%s' is not running\n",
+		ctrl_shm->thread_name);
+	    dog = 1;
+	}
+	in = atomic_load_explicit(&ctrl_shm->stream_in, memory_order_acquire);
+	out_idx = ctrl_shm->stream_out;
+	while (out_idx != in && (count < 0 || written < count)) {
+	    /* copy out the longest run that doesn't wrap */
+	    int run = (in > out_idx ? in : len) - out_idx;
+	    if (count >= 0 && run > count - written) {
+		run = count - written;
+	    }
+	    if (write_run(out, buffer + out_idx * ctrl_shm->sample_len,
+		    run) < 0) {
+		perror("halrecord: write");
+		return -1;
+	    }
+	    written += run;
+	    out_idx += run;
+	    if (out_idx >= len) {
+		out_idx = 0;
+	    }
+	    atomic_store_explicit(&ctrl_shm->stream_out, out_idx,
+		memory_order_release);
+	}
+	if (ctrl_shm->lost != lost_reported) {
+	    lost_reported = ctrl_shm->lost;
+	    fprintf(stderr, "halrecord: %lu samples lost so far\n",
+		lost_reported);
+	}
+	fflush(out);
+	usleep(10000);
+    }
+    fprintf(stderr, "halrecord: %ld samples written, %lu lost\n",
+	written, ctrl_shm->lost);
+    return 0;
+}
+
+/* read a file written by record() and print it as text */
+static int decode(FILE *in)
+{
+    char line[256], name[256], typ[16];
+    int n, len[SCOPE_MAX_CHANNELS];
+    hal_type_t type[SCOPE_MAX_CHANNELS];
+    rtapi_u32 hdr[2], next = 0;
+    int have_next = 0;
+
+    if (!fgets(line, sizeof(line), in) || strcmp(line, MAGIC) != 0) {
+	fprintf(stderr, "halrecord: not a halrecord file\n");
+	return -1;
+    }
+    num_chans = -1;
+    while (fgets(line, sizeof(line), in) && strcmp(line, "data\n") != 0) {
+	if (sscanf(line, "channels %d", &n) == 1) {
+	    if (n < 0 || n > SCOPE_MAX_CHANNELS) {
+		fprintf(stderr, "halrecord: bad channel count %d\n", n);
+		return -1;
+	    }
+	    num_chans = n;
+	    n = 0;
+	    printf("# sample");
+	    while (n < num_chans && fgets(line, sizeof(line), in)
+		&& sscanf(line, "%15s %s", typ, name) == 2) {
+		if (!strcmp(typ, "bit")) type[n] = HAL_BIT;
+		else if (!strcmp(typ, "float")) type[n] = HAL_FLOAT;
+		else if (!strcmp(typ, "s32")) type[n] = HAL_S32;
+		else if (!strcmp(typ, "u32")) type[n] = HAL_U32;
+		else if (!strcmp(typ, "s64")) type[n] = HAL_S64;
+		else if (!strcmp(typ, "u64")) type[n] = HAL_U64;
+		else {
+		    fprintf(stderr, "halrecord: unknown type '%s'\n", typ);
+		    return -1;
+		}
+		len[n] = type_len(type[n]);
+		printf(" %s", name);
+		n++;
+	    }
+	    printf("\n");
+	    if (n != num_chans) {
+		fprintf(stderr, "halrecord: truncated header\n");
+		return -1;
+	    }
+	} else {
+	    /* byteorder, thread: pass them along as comments */
+	    printf("# %s", line);
+	}
+    }
+    if (num_chans < 0) {
+	fprintf(stderr, "halrecord: no channels in header\n");
+	return -1;
+    }
+    while (fread(hdr, sizeof(hdr), 1, in) == 1) {
+	rtapi_u32 k, count = hdr[1];
+	if (have_next && hdr[0] != next) {
+	    printf("# lost %u samples\n", hdr[0] - next);
+	}
+	for (k = 0; k < count; k++) {
+	    printf("%u", hdr[0] + k);
+	    for (n = 0; n < num_chans; n++) {
+		scope_data_t d;
+		d.d_ireal = 0;
+		if (fread(&d, len[n], 1, in) != 1) {
+		    /* file cut short, e.g. by a crash */
+		    printf("\n");
+		    return 0;
+		}
+		switch (type[n]) {
+		case HAL_BIT: printf(" %d", d.d_u8); break;
+		case HAL_FLOAT: printf(" %.17g", d.d_real); break;
+		case HAL_S32: printf(" %" PRId32, d.d_s32); break;
+		case HAL_U32: printf(" %" PRIu32, d.d_u32); break;
+		case HAL_S64: printf(" %" PRId64, (int64_t) d.d_ireal); break;
+		default: printf(" %" PRIu64, (uint64_t) d.d_ireal); break;
+		}
+	    }
+	    printf("\n");
+	}
+	next = hdr[0] + count;
+	have_next = 1;
+    }
+    return 0;
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+	"Usage:\n"
+	"  halrecord [-t thread] [-m mult] [-n count] [-b size] [-o file] name...\n"
+	"  halrecord -d [file]\n");
+}
+
+/***********************************************************************
+*                            MAIN PROGRAM                              *
+************************************************************************/
+
+int main(int argc, char **argv)
+{
+    const char *thread_name = "servo-thread";
+    const char *ofilename = NULL;
+    long count = -1, num_samples = 1 << 20;
+    int mult = 1, dump = 0, exitval = 1, c, n;
+    hal_thread_t *thread;
+    long period;
+    FILE *out = stdout;
+
+    while ((c = getopt(argc, argv, "t:m:n:b:o:dh")) != -1) {
+	switch (c) {
+	case 't': thread_name = optarg; break;
+	case 'm': mult = atoi(optarg); break;
+	case 'n': count = atol(optarg); break;
+	case 'b': num_samples = atol(optarg); break;
+	case 'o': ofilename = optarg; break;
+	case 'd': dump = 1; break;
+	default:
+	    usage();
+	    return 1;
+	}
+    }
+    if (dump) {
+	FILE *in = stdin;
+	if (optind < argc && !(in = fopen(argv[optind], "rb"))) {
+	    perror(argv[optind]);
+	    return 1;
+	}
+	return decode(in) < 0;
+    }
+    num_chans = argc - optind;
+    if (num_chans < 1 || num_chans > SCOPE_MAX_CHANNELS || mult < 1
+	|| count == 0 || num_samples < 1) {
+	usage();
+	return 1;
+    }
+    for (n = 0; n < num_chans; n++) {
+	chan_name[n] = argv[optind + n];
+    }
+    if (ofilename && !(out = fopen(ofilename, "wb"))) {
+	perror(ofilename);
+	return 1;
+    }
+    setvbuf(out, NULL, _IOFBF, 1 << 20);
+
+    signal(SIGINT, quit);
+    signal(SIGTERM, quit);
+    signal(SIGPIPE, quit);
+
+    {
+	char comp_name[HAL_NAME_LEN + 1];
+	snprintf(comp_name, sizeof(comp_name), "halrecord%d", getpid());
+	comp_id = hal_init(comp_name);
+    }
+    if (comp_id < 0) {
+	fprintf(stderr, "halrecord: hal_init() failed: %d\n", comp_id);
+	return 1;
+    }
+    hal_ready(comp_id);
+    if (connect_scope(num_samples) < 0) {
+	goto out;
+    }
+    if (ctrl_shm->state != IDLE || ctrl_shm->thread_name[0] != '\0') {
+	fprintf(stderr, "halrecord: scope_rt is in use (is halscope running?)\n");
+	goto out;
+    }
+    if ((num_chans + 1) * 2 > ctrl_shm->buf_len) {
+	fprintf(stderr, "halrecord: scope_rt buffer too small for %d channels\n",
+	    num_chans);
+	goto out;
+    }
+
+    rtapi_mutex_get(&(hal_data->mutex));
+    thread = halpr_find_thread_by_name(thread_name);
+    period = thread ? thread->period : 0;
+    for (n = 0; n < SCOPE_MAX_CHANNELS; n++) {
+	ctrl_shm->data_len[n] = 0;
+    }
+    for (n = 0; thread && n < num_chans; n++) {
+	if (find_source(n, chan_name[n]) < 0) {
+	    break;
+	}
+    }
+    rtapi_mutex_give(&(hal_data->mutex));
+    if (!thread) {
+	fprintf(stderr, "halrecord: no thread '%s'\n", thread_name);
+	goto out;
+    }
+    if (n < num_chans) {
+	goto out;
+    }
+
+    if (hal_add_funct_to_thread("scope.sample", thread_name, -1) < 0) {
+	fprintf(stderr, "halrecord: can't add scope.sample to '%s'\n",
+	    thread_name);
+	goto out;
+    }
+    snprintf(ctrl_shm->thread_name, sizeof(ctrl_shm->thread_name), "%s",
+	thread_name);
+    attached = 1;
+
+    write_header(out, thread_name, period, mult);
+    ctrl_shm->mult = mult;
+    ctrl_shm->sample_len = num_chans + 1;
+    ctrl_shm->trig_chan = 0;
+    ctrl_shm->stream = 1;
+    ctrl_shm->watchdog = 0;
+    ctrl_shm->state = INIT;
+    /* wait for the realtime code to pick up the request */
+    for (n = 0; n < 100 && ctrl_shm->state == INIT; n++) {
+	usleep(10000);
+    }
+    if (ctrl_shm->state != STREAM) {
+	fprintf(stderr, "halrecord: scope_rt did not start streaming\n");
+	goto out;
+    }
+    if (record(out, count) == 0) {
+	exitval = 0;
+    }
+
+out:
+    disconnect_scope();
+    if (out != stdout || ofilename) {
+	fclose(out);
+    } else {
+	fflush(out);
+    }
+    if (shm_id >= 0) {
+	rtapi_shmem_delete(shm_id, comp_id);
+    }
+    hal_exit(comp_id);
+    return exitval;
+}
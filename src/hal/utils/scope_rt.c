@@ -38,6 +38,7 @@
 #include "../hal_priv.h"	/* HAL private API decls */
 #include "scope_rt.h"		/* scope related declarations */
 #include "rtapi_string.h"
+#include "rtapi_atomic.h"
 
 /* module information */
 MODULE_AUTHOR("John Kasunich");
@@ -72,6 +73,7 @@ static void init_shm_control_struct(void);
 
 static void sample(void *arg, long period);
 static void capture_sample(void);
+static void stream_sample(void);
 static int check_trigger(void);
 
 /***********************************************************************
@@ -177,10 +179,30 @@ static void sample(void *arg, long period)
 	ctrl_shm->force_trig = 0;
 	ctrl_rt->auto_timer = 0;
 	/* get info about channels */
-	for (n = 0; n < 16; n++) {
+	ctrl_rt->num_chans = 0;
+	for (n = 0; n < SCOPE_MAX_CHANNELS; n++) {
 	    ctrl_rt->data_addr[n] = SHMPTR(ctrl_shm->data_offset[n]);
 	    ctrl_rt->data_type[n] = ctrl_shm->data_type[n];
 	    ctrl_rt->data_len[n] = ctrl_shm->data_len[n];
+	    if (ctrl_rt->data_len[n] != 0) {
+		ctrl_rt->num_chans = n + 1;
+	    }
+	}
+	if (ctrl_shm->stream) {
+	    /* each sample is a sequence number followed by the data */
+	    if (ctrl_shm->sample_len < 2
+		|| ctrl_shm->buf_len / ctrl_shm->sample_len < 2) {
+		/* nonsense request, refuse it */
+		ctrl_shm->state = IDLE;
+		break;
+	    }
+	    ctrl_shm->stream_len = ctrl_shm->buf_len / ctrl_shm->sample_len;
+	    ctrl_shm->stream_in = 0;
+	    ctrl_shm->stream_out = 0;
+	    ctrl_shm->lost = 0;
+	    ctrl_rt->stream_seq = 0;
+	    ctrl_shm->state = STREAM;
+	    break;
 	}
 	/* set next state */
 	ctrl_shm->state = PRE_TRIG;
@@ -232,6 +254,9 @@ static void sample(void *arg, long period)
     case DONE:
 	/* do nothing while GUI displays waveform */
 	break;
+    case STREAM:
+	stream_sample();
+	break;
     default:
 	/* shouldn't get here - if we do, set a legal state */
 	ctrl_shm->state = IDLE;
@@ -247,7 +272,7 @@ static void capture_sample(void)
 
     dest = &(ctrl_rt->buffer[ctrl_shm->curr]);
     /* loop through all channels to acquire data */
-    for (n = 0; n < 16; n++) {
+    for (n = 0; n < ctrl_rt->num_chans; n++) {
 	/* capture 1, 2, or 4 bytes, based on data size */
 	switch (ctrl_rt->data_len[n]) {
 	case 1:
@@ -282,6 +307,29 @@ static void capture_sample(void)
     }
 }
 
+static void stream_sample(void)
+{
+    int in, next;
+
+    /* the sequence number counts samples that had to be dropped too */
+    ctrl_rt->stream_seq++;
+    in = ctrl_shm->stream_in;
+    next = in + 1;
+    if (next >= ctrl_shm->stream_len) {
+	next = 0;
+    }
+    if (next == atomic_load_explicit(&ctrl_shm->stream_out,
+	    memory_order_acquire)) {
+	/* ring is full, the reader has fallen behind */
+	ctrl_shm->lost++;
+	return;
+    }
+    ctrl_rt->buffer[in * ctrl_shm->sample_len].d_u32 = ctrl_rt->stream_seq;
+    ctrl_shm->curr = in * ctrl_shm->sample_len + 1;
+    capture_sample();
+    atomic_store_explicit(&ctrl_shm->stream_in, next, memory_order_release);
+}
+
 // TODO: type-independent way to get high bit
 // #define SIGN_BIT (~(((ireal_t)~(ireal_t)0)>>1))
 static int check_trigger(void)
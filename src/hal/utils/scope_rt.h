@@ -49,9 +49,11 @@ typedef struct {
     scope_data_t *buffer;	/* ptr to buffer (kernel mapping) */
     int mult_cntr;		/* used to divide by 'mult' */
     int auto_timer;		/* delay timer for auto triggering */
-    char data_len[16];		/* data size for each channel */
-    void *data_addr[16];	/* pointers to data for each channel */
-    hal_type_t data_type[16];	/* data type for each channel */
+    int num_chans;		/* highest channel to be acquired, plus 1 */
+    rtapi_u32 stream_seq;	/* sample periods since streaming started */
+    char data_len[SCOPE_MAX_CHANNELS];	/* data size for each channel */
+    void *data_addr[SCOPE_MAX_CHANNELS];	/* pointers to data for each channel */
+    hal_type_t data_type[SCOPE_MAX_CHANNELS];	/* data type for each channel */
 } scope_rt_control_t;
 
 /***********************************************************************
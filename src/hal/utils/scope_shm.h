@@ -43,6 +43,7 @@
 
 #define SCOPE_SHM_KEY  0x130CF406
 #define SCOPE_NUM_SAMPLES_DEFAULT 16000
+#define SCOPE_MAX_CHANNELS 64	/* halscope itself uses the first 16 */
 
 typedef enum {
     IDLE = 0,			/* waiting for run command */
@@ -51,7 +52,8 @@ typedef enum {
     TRIG_WAIT,			/* waiting for trigger */
     POST_TRIG,			/* acquiring post-trigger data */
     DONE,			/* data acquisition complete */
-    RESET			/* data acquisition interrupted */
+    RESET,			/* data acquisition interrupted */
+    STREAM			/* continuous acquisition into a ring */
 } scope_state_t;
 
 /* this struct holds a single value - one sample of one channel */
@@ -88,9 +90,21 @@ typedef struct {
     int curr;			/* R next sample to be acquired */
     int samples;		/* R number of valid samples */
     scope_state_t state;	/* RU current state */
-    int data_offset[16];	/* U data addr in shmem for each channel */
-    hal_type_t data_type[16];	/* U data type for each channel */
-    char data_len[16];		/* U data size, 0 if not to be acquired */
+    int data_offset[SCOPE_MAX_CHANNELS];	/* U data addr in shmem for each channel */
+    hal_type_t data_type[SCOPE_MAX_CHANNELS];	/* U data type for each channel */
+    char data_len[SCOPE_MAX_CHANNELS];	/* U data size, 0 if not to be acquired */
+    /* Streaming: if 'stream' is set when the state goes to INIT, the
+       realtime code goes to STREAM instead of PRE_TRIG, and from then
+       on treats the buffer as a ring of 'stream_len' samples that a
+       user space reader empties while acquisition continues (see
+       halrecord).  Each sample starts with a u32 sequence number that
+       counts every sample period, so the reader can tell exactly where
+       samples were dropped because it fell behind. */
+    int stream;			/* U nonzero to stream instead of trigger */
+    int stream_len;		/* R number of samples in the ring */
+    volatile int stream_in;	/* R next sample to be written */
+    volatile int stream_out;	/* U next sample to be read */
+    unsigned long lost;		/* R samples dropped, ring was full */
 } scope_shm_control_t;
 
 #endif /* HALSC_SHM_H */
@@ -92,9 +92,15 @@ struct REMOTE_BLOCKING_READ_REQUEST:public REMOTE_CMS_REQUEST {
 struct REMOTE_GET_BUF_NAME_REQUEST:public REMOTE_CMS_REQUEST {
     REMOTE_GET_BUF_NAME_REQUEST():REMOTE_CMS_REQUEST
 	(REMOTE_CMS_GET_BUF_NAME_REQUEST_TYPE) {
+	abi_signature = 0;
     };
+    unsigned long abi_signature;	/* cms_abi_signature() of the
+					   client, or 0 if not sent */
 };
 
+/* Marks the client's ABI signature in a TCP GET_BUF_NAME request. */
+#define REMOTE_CMS_ABI_MAGIC 0x41424931
+
 struct REMOTE_READ_REQUEST:public REMOTE_CMS_REQUEST {
     REMOTE_READ_REQUEST():REMOTE_CMS_REQUEST(REMOTE_CMS_READ_REQUEST_TYPE) {
     };
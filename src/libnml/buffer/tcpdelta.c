@@ -0,0 +1,164 @@
+/********************************************************************
+* Description: tcpdelta.c
+*   Delta encoding of NML messages sent by the TCP server to TCPMEM
+*   clients of buffers configured with "delta".
+*
+* Author:
+* License: LGPL Version 2
+* System: Linux
+*
+* Last change:
+********************************************************************/
+
+#include <string.h>		/* memcmp(), memcpy(), memset() */
+#include <stdint.h>		/* uint32_t */
+#include <arpa/inet.h>		/* htonl(), ntohl() */
+#include "tcpdelta.h"
+
+/* Runs closer than this are merged; a run header costs 8 bytes. */
+#define TCPDELTA_MIN_GAP 9
+
+static void put32(unsigned char *addr, uint32_t val)
+{
+    val = htonl(val);
+    memcpy(addr, &val, sizeof(val));
+}
+
+static uint32_t get32(const unsigned char *addr)
+{
+    uint32_t val;
+    memcpy(&val, addr, sizeof(val));
+    return ntohl(val);
+}
+
+/* Index of the first byte at or after i where data and base differ. */
+static long next_diff(const unsigned char *data, const unsigned char *base,
+    long base_size, long i, long size)
+{
+    static const unsigned char zeros[64];
+    while (i < size) {
+	const unsigned char *b;
+	long n = size - i;
+	if (i < base_size) {
+	    b = base + i;
+	    if (n > base_size - i) {
+		n = base_size - i;
+	    }
+	} else {
+	    b = zeros;
+	}
+	if (n > (long) sizeof(zeros)) {
+	    n = sizeof(zeros);
+	}
+	if (memcmp(data + i, b, n)) {
+	    while (data[i] == *b) {
+		i++;
+		b++;
+	    }
+	    return i;
+	}
+	i += n;
+    }
+    return size;
+}
+
+long tcpdelta_encode(const void *base, long base_size,
+    unsigned long base_id, const void *data, long size, void *out)
+{
+    const unsigned char *d = (const unsigned char *) data;
+    const unsigned char *b = (const unsigned char *) base;
+    unsigned char *o = (unsigned char *) out;
+    long pos = TCPDELTA_HEADER_SIZE;
+    long limit = TCPDELTA_HEADER_SIZE + size;
+    long i;
+
+    if (NULL == b) {
+	base_size = 0;
+	base_id = 0;
+    }
+    put32(o, NULL == b ? TCPDELTA_KEY : TCPDELTA_DELTA);
+    put32(o + 4, base_id);
+    put32(o + 8, size);
+
+    i = next_diff(d, b, base_size, 0, size);
+    while (i < size) {
+	long start = i, end;
+	/* extend the run while the next difference is close */
+	do {
+	    end = i + 1;
+	    while (end < size && (end >= base_size ?
+		    d[end] != 0 : d[end] != b[end])) {
+		end++;
+	    }
+	    i = next_diff(d, b, base_size, end, size);
+	} while (i < size && i - end < TCPDELTA_MIN_GAP);
+	if (pos + 8 + (end - start) > limit) {
+	    put32(o, TCPDELTA_RAW);
+	    put32(o + 4, 0);
+	    memcpy(o + TCPDELTA_HEADER_SIZE, d, size);
+	    return limit;
+	}
+	put32(o + pos, start);
+	put32(o + pos + 4, end - start);
+	memcpy(o + pos + 8, d + start, end - start);
+	pos += 8 + (end - start);
+    }
+    return pos;
+}
+
+long tcpdelta_decode(void *ref, long ref_max, long ref_size,
+    unsigned long ref_id, const void *in, long in_size)
+{
+    unsigned char *r = (unsigned char *) ref;
+    const unsigned char *p = (const unsigned char *) in;
+    long pos = TCPDELTA_HEADER_SIZE;
+    uint32_t kind, base_id;
+    long size;
+
+    if (in_size < TCPDELTA_HEADER_SIZE) {
+	return -1;
+    }
+    kind = get32(p);
+    base_id = get32(p + 4);
+    size = get32(p + 8);
+    if (size > ref_max) {
+	return -1;
+    }
+    switch (kind) {
+    case TCPDELTA_RAW:
+	if (in_size != TCPDELTA_HEADER_SIZE + size) {
+	    return -1;
+	}
+	memcpy(r, p + TCPDELTA_HEADER_SIZE, size);
+	return size;
+    case TCPDELTA_KEY:
+	memset(r, 0, size);
+	break;
+    case TCPDELTA_DELTA:
+	if (base_id != (uint32_t) ref_id) {
+	    return -1;
+	}
+	if (size > ref_size) {
+	    memset(r + ref_size, 0, size - ref_size);
+	}
+	break;
+    default:
+	return -1;
+    }
+    while (pos < in_size) {
+	uint32_t offset, len;
+	if (in_size - pos < 8) {
+	    return -1;
+	}
+	offset = get32(p + pos);
+	len = get32(p + pos + 4);
+	pos += 8;
+	if (len > (uint32_t) (in_size - pos) || offset > (uint32_t) size ||
+	    len > (uint32_t) size - offset) {
+	    return -1;
+	}
+	memcpy(r + offset, p + pos, len);
+	pos += len;
+    }
+    return size;
+}
@@ -0,0 +1,48 @@
+/********************************************************************
+* Description: tcpdelta.h
+*   Delta encoding of NML messages sent by the TCP server to TCPMEM
+*   clients of buffers configured with "delta".
+*
+* Author:
+* License: LGPL Version 2
+* System: Linux
+*
+* Last change:
+********************************************************************/
+
+#ifndef TCPDELTA_H
+#define TCPDELTA_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* An encoded message starts with three big endian words: the kind, the
+   write_id of the message it is based on and the size of the full message.
+   A key frame or delta is followed by runs of (offset, length, bytes) that
+   differ from the base; the base of a key frame is all zeros.  A raw frame
+   is followed by the message itself. */
+#define TCPDELTA_HEADER_SIZE 12
+#define TCPDELTA_KEY 0
+#define TCPDELTA_DELTA 1
+#define TCPDELTA_RAW 2
+
+#define TCPDELTA_DEFAULT_KEYFRAME_INTERVAL 100
+
+/* Encodes size bytes of data against base, or against zeros if base is
+   NULL, into out, which must hold size + TCPDELTA_HEADER_SIZE bytes.
+   Returns the number of bytes written. */
+    long tcpdelta_encode(const void *base, long base_size,
+	unsigned long base_id, const void *data, long size, void *out);
+
+/* Rebuilds a message in ref, which holds ref_size bytes of message ref_id
+   and has room for ref_max.  Returns the size of the message, or -1 if
+   the frame is corrupt, too big or based on a message ref does not hold. */
+    long tcpdelta_decode(void *ref, long ref_max, long ref_size,
+	unsigned long ref_id, const void *in, long in_size);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* TCPDELTA_H */
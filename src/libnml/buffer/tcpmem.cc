@@ -44,6 +44,7 @@ extern "C" {
 #include "tcpmem.hh"
 #include "recvn.h"		/* recvn() */
 #include "sendn.h"		/* sendn() */
+#include "tcpdelta.h"		/* tcpdelta_decode() */
 #include "tcp_opts.hh"		/* SET_TCP_NODELAY */
 #include "linklist.hh"          /* LinkedList */
 
@@ -72,6 +73,10 @@ TCPMEM::TCPMEM(const char *_bufline, const char *_procline):CMS(_bufline, _procl
     write_serial_number = 0;
     read_socket_fd = 0;
     write_socket_fd = 0;
+    delta_in = NULL;
+    delta_ref = NULL;
+    delta_ref_size = 0;
+    delta_ref_id = 0;
     if (NULL != max_consecutive_timeouts_string) {
 	max_consecutive_timeouts_string += strlen("max_timeouts=");
 	if (!strncmp(max_consecutive_timeouts_string, "INF", 3)) {
@@ -100,6 +105,17 @@ TCPMEM::TCPMEM(const char *_bufline, const char *_procline):CMS(_bufline, _procl
     if (NULL != strstr(ProcessLine, "noreconnect")) {
 	autoreconnect = 0;
     }
+    if (delta_keyframe_interval > 0) {
+	delta_in = (char *) malloc(max_encoded_message_size +
+	    TCPDELTA_HEADER_SIZE);
+	delta_ref = (char *) malloc(max_encoded_message_size);
+	if (NULL == delta_in || NULL == delta_ref) {
+	    rcs_print_error("TCPMEM: Can't allocate delta buffers.\n");
+	    status = CMS_CREATE_ERROR;
+	    autoreconnect = 0;
+	    return;
+	}
+    }
     server_host_entry = NULL;
 
     /* Set up the socket address structure. */
@@ -215,6 +231,8 @@ void TCPMEM::verify_bufname()
     putbe32(temp_buffer, (uint32_t) serial_number);
     putbe32(temp_buffer + 4, REMOTE_CMS_GET_BUF_NAME_REQUEST_TYPE);
     putbe32(temp_buffer + 8, buffer_number);
+    putbe32(temp_buffer + 12, REMOTE_CMS_ABI_MAGIC);
+    putbe32(temp_buffer + 16, (uint32_t) cms_abi_signature());
     if (sendn(socket_fd, temp_buffer, 20, 0, timeout) < 0) {
 	reconnect_needed = 1;
 	fatal_error_occurred = 1;
@@ -248,6 +266,11 @@ void TCPMEM::verify_bufname()
 	return;
     }
     status = (CMS_STATUS) ntohl(*((uint32_t *) temp_buffer + 1));
+    if (status == CMS_CONFIG_ERROR && force_raw) {
+	rcs_print_error
+	    ("TCPMEM: The server of %s on %s lays out data differently from this host, so force_raw can not be used.\n",
+	    BufferName, BufferHost);
+    }
     if (status < 0) {
 	return;
     }
@@ -431,6 +454,8 @@ void TCPMEM::reconnect()
     waiting_message_size = 0;
     waiting_message_id = 0;
     serial_number = 0;
+    delta_ref_size = 0;
+    delta_ref_id = 0;
 
     rcs_print_debug(PRINT_CMS_CONFIG_INFO, "Creating socket . . .\n");
 
@@ -631,6 +656,52 @@ void TCPMEM::reconnect()
 TCPMEM::~TCPMEM()
 {
     disconnect();
+    if (NULL != delta_in) {
+	free(delta_in);
+	delta_in = NULL;
+    }
+    if (NULL != delta_ref) {
+	free(delta_ref);
+	delta_ref = NULL;
+    }
+}
+
+/* Where the data of a read reply is received: straight into encoded_data,
+   or into delta_in to be rebuilt by decode_delta(). */
+void *TCPMEM::reply_buffer()
+{
+    if (NULL != delta_in) {
+	return delta_in;
+    }
+    return encoded_data;
+}
+
+long TCPMEM::max_reply_size()
+{
+    if (NULL != delta_in) {
+	return max_encoded_message_size + TCPDELTA_HEADER_SIZE;
+    }
+    return max_encoded_message_size;
+}
+
+/* Rebuilds message id from the delta frame in delta_in and copies it to
+   encoded_data.  On failure the reference is dropped, so the caller should
+   report the message as old and the server sends a key frame next. */
+int TCPMEM::decode_delta(long message_size, unsigned long id)
+{
+    long size = tcpdelta_decode(delta_ref, max_encoded_message_size,
+	delta_ref_size, delta_ref_id, delta_in, message_size);
+    if (size < 0) {
+	rcs_print_error("TCPMEM: Bad delta frame for message %lu of %s.\n",
+	    id, BufferName);
+	delta_ref_size = 0;
+	delta_ref_id = 0;
+	return -1;
+    }
+    delta_ref_size = size;
+    delta_ref_id = id;
+    memcpy(encoded_data, delta_ref, size);
+    return 0;
 }
 
 void TCPMEM::disconnect()
@@ -717,9 +788,9 @@ CMS_STATUS TCPMEM::handle_old_replies()
 		(CMS_STATUS) ntohl(*((uint32_t *) temp_buffer + 1));
 	    timedout_request_writeid = ntohl(*((uint32_t *) temp_buffer + 3));
 	    header.was_read = ntohl(*((uint32_t *) temp_buffer + 4));
-	    if (message_size > max_encoded_message_size) {
+	    if (message_size > max_reply_size()) {
 		rcs_print_error("Received message is too big. (%ld > %ld)\n",
-		    message_size, max_encoded_message_size);
+		    message_size, max_reply_size());
 		fatal_error_occurred = 1;
 		reconnect_needed = 1;
 		return (status = CMS_INSUFFICIENT_SPACE_ERROR);
@@ -729,7 +800,7 @@ CMS_STATUS TCPMEM::handle_old_replies()
 	}
 	if (message_size > 0) {
 	    if (recvn
-		(socket_fd, encoded_data, message_size, 0, timeout,
+		(socket_fd, reply_buffer(), message_size, 0, timeout,
 		    &recvd_bytes) < 0) {
 		if (recvn_timedout) {
 		    if (!waiting_for_message) {
@@ -763,6 +834,10 @@ CMS_STATUS TCPMEM::handle_old_replies()
 	    if (waiting_for_message) {
 		timedout_request_writeid = waiting_message_id;
 	    }
+	    if (NULL != delta_in &&
+		decode_delta(message_size, timedout_request_writeid) < 0) {
+		timedout_request_writeid = 0;
+	    }
 	}
 	break;
 
@@ -1016,9 +1091,9 @@ CMS_STATUS TCPMEM::read()
     message_size = ntohl(*((uint32_t *) temp_buffer + 2));
     id = ntohl(*((uint32_t *) temp_buffer + 3));
     header.was_read = ntohl(*((uint32_t *) temp_buffer + 4));
-    if (message_size > max_encoded_message_size) {
+    if (message_size > max_reply_size()) {
 	rcs_print_error("Received message is too big. (%ld > %ld)\n",
-	    message_size, max_encoded_message_size);
+	    message_size, max_reply_size());
 	fatal_error_occurred = 1;
 	reconnect_needed = 1;
 	reenable_sigpipe();
@@ -1026,7 +1101,7 @@ CMS_STATUS TCPMEM::read()
     }
     if (message_size > 0) {
 	if (recvn
-	    (socket_fd, encoded_data, message_size, 0, timeout,
+	    (socket_fd, reply_buffer(), message_size, 0, timeout,
 		&recvd_bytes) < 0) {
 	    if (recvn_timedout) {
 		if (!waiting_for_message) {
@@ -1052,6 +1127,10 @@ CMS_STATUS TCPMEM::read()
 	}
     }
     recvd_bytes = 0;
+    if (NULL != delta_in && message_size > 0 &&
+	decode_delta(message_size, id) < 0) {
+	id = 0;
+    }
     check_id(id);
     reenable_sigpipe();
     return (status);
@@ -1219,9 +1298,9 @@ CMS_STATUS TCPMEM::blocking_read(double _blocking_timeout)
     message_size = ntohl(*((uint32_t *) temp_buffer + 2));
     id = ntohl(*((uint32_t *) temp_buffer + 3));
     header.was_read = ntohl(*((uint32_t *) temp_buffer + 4));
-    if (message_size > max_encoded_message_size) {
+    if (message_size > max_reply_size()) {
 	rcs_print_error("Received message is too big. (%ld > %ld)\n",
-	    message_size, max_encoded_message_size);
+	    message_size, max_reply_size());
 	fatal_error_occurred = 1;
 	reconnect_needed = 1;
 	reenable_sigpipe();
@@ -1229,7 +1308,7 @@ CMS_STATUS TCPMEM::blocking_read(double _blocking_timeout)
     }
     if (message_size > 0) {
 	if (recvn
-	    (socket_fd, encoded_data, message_size, 0, blocking_timeout,
+	    (socket_fd, reply_buffer(), message_size, 0, blocking_timeout,
 		&recvd_bytes) < 0) {
 	    if (recvn_timedout) {
 		if (!waiting_for_message) {
@@ -1255,6 +1334,10 @@ CMS_STATUS TCPMEM::blocking_read(double _blocking_timeout)
 	}
     }
     recvd_bytes = 0;
+    if (NULL != delta_in && message_size > 0 &&
+	decode_delta(message_size, id) < 0) {
+	id = 0;
+    }
     check_id(id);
     reenable_sigpipe();
     return (status);
@@ -1405,16 +1488,16 @@ CMS_STATUS TCPMEM::peek()
     message_size = ntohl(*((uint32_t *) temp_buffer + 2));
     id = ntohl(*((uint32_t *) temp_buffer + 3));
     header.was_read = ntohl(*((uint32_t *) temp_buffer + 4));
-    if (message_size > max_encoded_message_size) {
+    if (message_size > max_reply_size()) {
 	reconnect_needed = 1;
 	rcs_print_error("Received message is too big. (%ld > %ld)\n",
-	    message_size, max_encoded_message_size);
+	    message_size, max_reply_size());
 	reenable_sigpipe();
 	return (status = CMS_MISC_ERROR);
     }
     if (message_size > 0) {
 	if (recvn
-	    (socket_fd, encoded_data, message_size, 0, timeout,
+	    (socket_fd, reply_buffer(), message_size, 0, timeout,
 		&recvd_bytes) < 0) {
 	    if (recvn_timedout) {
 		if (!waiting_for_message) {
@@ -1440,6 +1523,10 @@ CMS_STATUS TCPMEM::peek()
 	}
     }
     recvd_bytes = 0;
+    if (NULL != delta_in && message_size > 0 &&
+	decode_delta(message_size, id) < 0) {
+	id = 0;
+    }
     check_id(id);
     reenable_sigpipe();
     return (status);
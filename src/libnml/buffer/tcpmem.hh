@@ -81,6 +81,13 @@ class TCPMEM:public CMS {
     void reenable_sigpipe();
     void verify_bufname();
     int subscription_count;
+    char *delta_in;		/* received delta frame, or NULL */
+    char *delta_ref;		/* last message rebuilt from delta frames */
+    long delta_ref_size;
+    unsigned long delta_ref_id;
+    void *reply_buffer();
+    long max_reply_size();
+    int decode_delta(long message_size, unsigned long id);
 };
 
 #endif
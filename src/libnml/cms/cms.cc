@@ -44,6 +44,7 @@ extern "C" {
 #include "cmsdiag.hh"
 #include "linklist.hh"          /* LinkedList */
 #include "physmem.hh"
+#include "tcpdelta.h"		/* TCPDELTA_DEFAULT_KEYFRAME_INTERVAL */
 
 LinkedList *cmsHostAliases = NULL;
 CMS_CONNECTION_MODE cms_connection_mode = CMS_NORMAL_CONNECTION_MODE;
@@ -139,6 +140,7 @@ CMS::CMS(long s)
     last_im = CMS_NOT_A_MODE;
     min_compatible_version = 0;
     confirm_write = 0;
+    delta_keyframe_interval = 0;
     disable_final_write_raw_for_dma = 0;
     subdiv_data = 0;
     enable_diagnostics = 0;
@@ -197,6 +199,7 @@ CMS::CMS(const char *bufline_in, const char *procline_in, int set_to_server)
     force_raw = 0;
     serial = 0;
     confirm_write = 0;
+    delta_keyframe_interval = 0;
     disable_final_write_raw_for_dma = 0;
     /* Init string buffers */
     memset(BufferName, 0, LINELEN);
@@ -430,6 +433,16 @@ CMS::CMS(const char *bufline_in, const char *procline_in, int set_to_server)
 	    confirm_write = 1;
 	    continue;
 	}
+	if (!strcmp(word[i], "DELTA")) {
+	    delta_keyframe_interval = TCPDELTA_DEFAULT_KEYFRAME_INTERVAL;
+	    continue;
+	}
+	char *delta_string;
+	if (NULL != (delta_string = strstr(word[i], "DELTA="))) {
+	    delta_keyframe_interval =
+		strtol(delta_string + 6, (char **) NULL, 0);
+	    continue;
+	}
 	if (!strcmp(word[i], "FORCE_RAW")) {
 	    force_raw = 1;
 	    continue;
@@ -587,6 +600,11 @@ CMS::CMS(const char *bufline_in, const char *procline_in, int set_to_server)
     if (min_compatible_version < 3.44 && min_compatible_version > 0) {
 	total_subdivisions = 1;
     }
+    if (delta_keyframe_interval > 0 && total_subdivisions > 1) {
+	rcs_print_error
+	    ("CMS: delta can not be used with subdivided buffers.\n");
+	delta_keyframe_interval = 0;
+    }
     if (queuing_enabled && split_buffer) {
 	rcs_print_error("CMS: Can not split buffer with queuing enabled.\n");
 	status = CMS_CONFIG_ERROR;
@@ -1640,3 +1658,19 @@ char *cms_check_for_host_alias(char *in)
     }
     return NULL;
 }
+
+/* Describes how this host lays out messages in memory: byte order, the
+   sizes of long and pointers and the alignment of double and long long.
+   Processes sharing a force_raw buffer over TCP must agree on it. */
+unsigned long cms_abi_signature(void)
+{
+    union {
+	unsigned int word;
+	unsigned char byte[sizeof(unsigned int)];
+    } order;
+    order.word = 1;
+    return ((unsigned long) order.byte[0] << 24) |
+	((sizeof(long) | sizeof(void *) << 4) << 16) |
+	((__alignof__(double) | __alignof__(long long) << 4) << 8) |
+	sizeof(long double);
+}
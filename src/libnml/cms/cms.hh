@@ -443,6 +443,7 @@ class CMS {
     double blocking_timeout;
     double min_compatible_version;
     int confirm_write;
+    int delta_keyframe_interval;	/* TCP delta encoding, 0 = off */
     int disable_final_write_raw_for_dma;
     virtual const char *status_string(int);
 
@@ -503,6 +504,7 @@ enum CMS_CONNECTION_MODE {
 extern CMS_CONNECTION_MODE cms_connection_mode;
 
 extern char *cms_check_for_host_alias(char *in);
+extern unsigned long cms_abi_signature(void);
 extern int cms_encoded_data_explosion_factor;
 extern int cms_print_queue_free_space;
 extern int cms_print_queue_full_messages;
@@ -564,6 +564,18 @@ int CMS_SERVER::get_total_subdivisions(long _buffer_number)
     return cms_local_port->cms->total_subdivisions;
 }
 
+int CMS_SERVER::get_delta_keyframe_interval(long _buffer_number)
+{
+    CMS_SERVER_LOCAL_PORT *cms_local_port = find_local_port(_buffer_number);
+    if (NULL == cms_local_port) {
+	return 0;
+    }
+    if (NULL == cms_local_port->cms) {
+	return 0;
+    }
+    return cms_local_port->cms->delta_keyframe_interval;
+}
+
 void CMS_SERVER::set_diag_info(REMOTE_SET_DIAG_INFO_REQUEST * _diag_info)
 {
     diag_enabled = 1;
@@ -630,6 +642,16 @@ REMOTE_CMS_REPLY *CMS_SERVER::process_request(REMOTE_CMS_REQUEST * _request)
 		return NULL;
 	    }
 	    strncpy(namereply->name, name, 31);
+	    namereply->status = CMS_STATUS_NOT_SET;
+	    unsigned long abi_signature =
+		((REMOTE_GET_BUF_NAME_REQUEST *) request)->abi_signature;
+	    if (local_port->cms->force_raw && 0 != abi_signature &&
+		abi_signature != cms_abi_signature()) {
+		rcs_print_error
+		    ("CMS_SERVER: A client of %s lays out data differently (ABI signature %lX, not %lX), so it can not share this force_raw buffer.\n",
+		    name, abi_signature, cms_abi_signature());
+		namereply->status = CMS_CONFIG_ERROR;
+	    }
 	    return namereply;
 	}
 
@@ -129,6 +129,7 @@ class CMS_SERVER {
 
   public:
     int get_total_subdivisions(long _buffer_num);
+    int get_delta_keyframe_interval(long _buffer_num);
     CMS_SERVER_REMOTE_PORT *remote_port;
     void gen_random_key(char key[], int len);
     int security_check(CMS_USER_INFO * user_info, int _buf_num);
@@ -39,7 +39,7 @@ extern "C" {
 #endif
 
 #include <sys/types.h>
-#include <sys/wait.h>		// waitpid
+#include <sys/epoll.h>		/* epoll_create1(), epoll_wait() */
 
 #include <arpa/inet.h>		/* inet_ntoa */
 #include "cms.hh"		/* class CMS */
@@ -54,14 +54,10 @@ extern "C" {
 extern "C" {
 #include "recvn.h"		/* recvn() */
 #include "sendn.h"		/* sendn() */
+#include "tcpdelta.h"		/* tcpdelta_encode() */
 }
 #include "physmem.hh"           // PHYSMEM_HANDLE
 
-int tcpsvr_threads_created = 0;
-int tcpsvr_threads_killed = 0;
-int tcpsvr_threads_exited = 0;
-int tcpsvr_threads_returned_early = 0;
-
 TCPSVR_BLOCKING_READ_REQUEST::TCPSVR_BLOCKING_READ_REQUEST()
 {
     access_type = CMS_READ_ACCESS;	/* read or just peek */
@@ -71,13 +67,10 @@ TCPSVR_BLOCKING_READ_REQUEST::TCPSVR_BLOCKING_READ_REQUEST()
     /* to this client */
     timeout_millis = -1;	/* Milliseconds for blocking_timeout or -1 to 
 				   wait forever */
-    _client_tcp_port = NULL;
-    remport = NULL;
-    server = NULL;
+    deadline = -1.0;
     _nml = NULL;
     _reply = NULL;
     _data = NULL;
-    read_reply = NULL;
 }
 
 static inline double tcp_svr_reverse_double(double in)
@@ -103,27 +96,12 @@ TCPSVR_BLOCKING_READ_REQUEST::~TCPSVR_BLOCKING_READ_REQUEST()
 	delete nmlcopy;
     }
     if (NULL != _data) {
-	void *_datacopy = _data;
-	if (NULL != read_reply) {
-	    if (_data == read_reply->data) {
-		read_reply->data = NULL;
-	    }
-	}
+	free(_data);
 	_data = NULL;
-	free(_datacopy);
     }
     if (NULL != _reply) {
 	free(_reply);
 	_reply = NULL;
-	read_reply = NULL;
-    }
-    if (NULL != read_reply) {
-	if (NULL != read_reply->data) {
-	    free(read_reply->data);
-	    read_reply->data = NULL;
-	}
-	delete read_reply;
-	read_reply = NULL;
     }
 }
 
@@ -133,7 +111,7 @@ CMS_SERVER_REMOTE_PORT(_cms_server)
     client_ports = (LinkedList *) NULL;
     connection_socket = 0;
     connection_port = 0;
-    maxfdpl = 0;
+    epoll_fd = -1;
     dtimeout = 20.0;
 
     memset(&server_socket_address, 0, sizeof(server_socket_address));
@@ -147,13 +125,18 @@ CMS_SERVER_REMOTE_PORT(_cms_server)
 	return;
     }
     polling_enabled = 0;
-    memset(&select_timeout, 0, sizeof(select_timeout));
-    select_timeout.tv_sec = 30;
-    select_timeout.tv_usec = 30;
+    next_poll_time = 0.0;
+    blocking_clients = 0;
+    waiting_clients = NULL;
+    waiting_clients_size = 0;
+    delta_frame = NULL;
+    delta_frame_alloc = 0;
+    delta_frame_size = -1;
+    delta_frame_buffer = -1;
+    delta_frame_write_id = 0;
+    delta_frame_base_id = 0;
     subscription_buffers = NULL;
     current_poll_interval_millis = 30000;
-    memset(&read_fd_set, 0, sizeof(read_fd_set));
-    memset(&write_fd_set, 0, sizeof(write_fd_set));
 }
 
 CMS_SERVER_REMOTE_TCP_PORT::~CMS_SERVER_REMOTE_TCP_PORT()
@@ -164,23 +147,16 @@ CMS_SERVER_REMOTE_TCP_PORT::~CMS_SERVER_REMOTE_TCP_PORT()
 	delete client_ports;
 	client_ports = (LinkedList *) NULL;
     }
-}
-
-void blocking_thread_kill(long int id)
-{
-
-    if (id <= 0) {
-	return;
+    if (NULL != waiting_clients) {
+	free(waiting_clients);
+	waiting_clients = NULL;
+	waiting_clients_size = 0;
+    }
+    if (NULL != delta_frame) {
+	free(delta_frame);
+	delta_frame = NULL;
+	delta_frame_alloc = 0;
     }
-#ifdef POSIX_THREADS
-    pthread_kill(id, SIGINT);
-    pthread_join(id, NULL);
-#endif
-#ifdef NO_THREADS
-    kill(id, SIGINT);
-    waitpid(id, NULL, 0);
-#endif
-    tcpsvr_threads_killed++;
 }
 
 void CMS_SERVER_REMOTE_TCP_PORT::unregister_port()
@@ -219,6 +195,10 @@ void CMS_SERVER_REMOTE_TCP_PORT::unregister_port()
 	close(connection_socket);
 	connection_socket = 0;
     }
+    if (epoll_fd >= 0) {
+	close(epoll_fd);
+	epoll_fd = -1;
+    }
 }
 
 int CMS_SERVER_REMOTE_TCP_PORT::accept_local_port_cms(CMS * _cms)
@@ -283,7 +263,7 @@ void CMS_SERVER_REMOTE_TCP_PORT::register_port()
 	    ntohs(server_socket_address.sin_port));
 	return;
     }
-    if (listen(connection_socket, 5) < 0) {
+    if (listen(connection_socket, SOMAXCONN) < 0) {
 	rcs_print_error("listen error: %d -- %s\n", errno, strerror(errno));
 	rcs_print_error("TCP Server: error on call to listen for port %d.\n",
 	    ntohs(server_socket_address.sin_port));
@@ -305,213 +285,121 @@ void CMS_SERVER_REMOTE_TCP_PORT::run()
 {
     int bytes_ready;
     int ready_descriptors;
+    struct epoll_event ev;
+    struct epoll_event events[TCPSVR_MAX_EVENTS];
     if (NULL == client_ports) {
 	rcs_print_error("CMS_SERVER: List of client ports is NULL.\n");
 	return;
     }
     CLIENT_TCP_PORT *new_client_port, *client_port_to_check;
-    FD_ZERO(&read_fd_set);
-    FD_ZERO(&write_fd_set);
-    FD_SET(connection_socket, &read_fd_set);
-    maxfdpl = connection_socket + 1;
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+	rcs_print_error("epoll_create1 error: %d -- %s\n", errno,
+	    strerror(errno));
+	return;
+    }
+    /* A NULL data.ptr marks the connection socket, anything else is the
+       CLIENT_TCP_PORT the event belongs to. */
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, connection_socket, &ev) < 0) {
+	rcs_print_error("epoll_ctl error: %d -- %s\n", errno,
+	    strerror(errno));
+	return;
+    }
     signal(SIGPIPE, handle_pipe_error);
     rcs_print_debug(PRINT_CMS_CONFIG_INFO,
 	"running server for TCP port %d (connection_socket = %d).\n",
 	ntohs(server_socket_address.sin_port), connection_socket);
 
     cms_server_count++;
-    fd_set read_fd_set_copy, write_fd_set_copy;
-    FD_ZERO(&read_fd_set_copy);
-    FD_ZERO(&write_fd_set_copy);
-    FD_SET(connection_socket, &read_fd_set_copy);
+    next_poll_time = etime();
 
     while (1) {
-	if (polling_enabled) {
-	    memcpy(&read_fd_set_copy, &read_fd_set, sizeof(fd_set));
-	    memcpy(&write_fd_set_copy, &write_fd_set, sizeof(fd_set));
-	    select_timeout.tv_sec = current_poll_interval_millis / 1000;
-	    select_timeout.tv_usec =
-		(current_poll_interval_millis % 1000) * 1000;
-	    ready_descriptors =
-		select(maxfdpl, &read_fd_set, &write_fd_set,
-		(fd_set *) NULL, (timeval *) & select_timeout);
-	    if (ready_descriptors == 0) {
-		update_subscriptions();
-		memcpy(&read_fd_set, &read_fd_set_copy, sizeof(fd_set));
-		memcpy(&write_fd_set, &write_fd_set_copy, sizeof(fd_set));
-		continue;
-	    }
-	} else {
-	    ready_descriptors =
-		select(maxfdpl, &read_fd_set, &write_fd_set,
-		(fd_set *) NULL, (timeval *) NULL);
-
-	}
+	ready_descriptors =
+	    epoll_wait(epoll_fd, events, TCPSVR_MAX_EVENTS,
+	    poll_timeout_millis());
 	if (ready_descriptors < 0) {
-	    rcs_print_error("server: select error.(errno = %d | %s)\n",
-		errno, strerror(errno));
+	    if (errno != EINTR) {
+		rcs_print_error("server: epoll_wait error.(errno = %d | %s)\n",
+		    errno, strerror(errno));
+	    }
+	    ready_descriptors = 0;
 	}
 	if (NULL == client_ports) {
 	    rcs_print_error("CMS_SERVER: List of client ports is NULL.\n");
 	    return;
 	}
-	client_port_to_check = (CLIENT_TCP_PORT *) client_ports->get_head();
-	while (NULL != client_port_to_check) {
-	    if (FD_ISSET(client_port_to_check->socket_fd, &read_fd_set)) {
+	for (int i = 0; i < ready_descriptors; i++) {
+	    client_port_to_check = (CLIENT_TCP_PORT *) events[i].data.ptr;
+	    if (NULL != client_port_to_check) {
+		bytes_ready = 0;
 		ioctl(client_port_to_check->socket_fd, FIONREAD,
 		    (caddr_t) & bytes_ready);
 		if (bytes_ready <= 0) {
 		    rcs_print_debug(PRINT_SOCKET_CONNECT,
 			"Socket closed by host with IP address %s.\n",
 			inet_ntoa(client_port_to_check->address.sin_addr));
-		    if (NULL != client_port_to_check->subscriptions) {
-			TCP_CLIENT_SUBSCRIPTION_INFO *clnt_sub_info =
-			    (TCP_CLIENT_SUBSCRIPTION_INFO *)
-			    client_port_to_check->subscriptions->get_head();
-			while (NULL != clnt_sub_info) {
-			    if (NULL != clnt_sub_info->sub_buf_info &&
-				clnt_sub_info->subscription_list_id >= 0) {
-				if (NULL !=
-				    clnt_sub_info->sub_buf_info->
-				    sub_clnt_info) {
-				    clnt_sub_info->sub_buf_info->
-					sub_clnt_info->
-					delete_node(clnt_sub_info->
-					subscription_list_id);
-				    if (clnt_sub_info->sub_buf_info->
-					sub_clnt_info->list_size < 1) {
-					delete clnt_sub_info->sub_buf_info->
-					    sub_clnt_info;
-					clnt_sub_info->sub_buf_info->
-					    sub_clnt_info = NULL;
-					if (NULL != subscription_buffers
-					    && clnt_sub_info->sub_buf_info->
-					    list_id >= 0) {
-					    subscription_buffers->
-						delete_node(clnt_sub_info->
-						sub_buf_info->list_id);
-					    delete clnt_sub_info->
-						sub_buf_info;
-					    clnt_sub_info->sub_buf_info =
-						NULL;
-					}
-				    }
-				    clnt_sub_info->sub_buf_info = NULL;
-				}
-				delete clnt_sub_info;
-				clnt_sub_info =
-				    (TCP_CLIENT_SUBSCRIPTION_INFO *)
-				    client_port_to_check->subscriptions->
-				    get_next();
-			    }
-			    delete client_port_to_check->subscriptions;
-			    client_port_to_check->subscriptions = NULL;
-			    recalculate_polling_interval();
-			}
-		    }
-		    if (client_port_to_check->threadId > 0
-			&& client_port_to_check->blocking) {
-			blocking_thread_kill(client_port_to_check->threadId);
-		    }
-		    close(client_port_to_check->socket_fd);
-		    FD_CLR(client_port_to_check->socket_fd, &read_fd_set);
-		    client_port_to_check->socket_fd = -1;
-		    delete client_port_to_check;
-		    client_ports->delete_current_node();
-		} else {
-		    if (client_port_to_check->blocking) {
-			if (client_port_to_check->threadId > 0) {
-			    rcs_print_debug(PRINT_SERVER_THREAD_ACTIVITY,
-				"Data received from %s:%d when it should be blocking (bytes_ready=%d).\n",
-				inet_ntoa
-				(client_port_to_check->address.
-				    sin_addr),
-				client_port_to_check->socket_fd, bytes_ready);
-			    rcs_print_debug(PRINT_SERVER_THREAD_ACTIVITY,
-				"Killing handler %d.\n",
-				client_port_to_check->threadId);
-
-			    blocking_thread_kill
-				(client_port_to_check->threadId);
-#if 0
-			    *((uint32_t *) temp_buffer) =
-				htonl(client_port_to_check->serial_number);
-			    *((uint32_t *) temp_buffer + 1) =
-				htonl((unsigned long)
-				CMS_SERVER_SIDE_ERROR);
-			    putbe32(temp_buffer + 8, 0);	/* size
-									 */
-			    putbe32(temp_buffer + 12, 0);	/* write_id
-									 */
-			    putbe32(temp_buffer + 16, 0);	/* was_read
-									 */
-			    sendn(client_port_to_check->socket_fd,
-				temp_buffer, 20, 0, dtimeout);
-#endif
-			    client_port_to_check->threadId = 0;
-			    client_port_to_check->blocking = 0;
-			}
-		    }
-		    handle_request(client_port_to_check);
+		    remove_client(client_port_to_check);
+		    continue;
 		}
-		ready_descriptors--;
-	    } else {
-		FD_SET(client_port_to_check->socket_fd, &read_fd_set);
+		if (client_port_to_check->blocking) {
+		    /* A new request supersedes the blocking read, which
+		       is dropped without a reply. */
+		    rcs_print_debug(PRINT_SERVER_THREAD_ACTIVITY,
+			"Data received from %s:%d when it should be blocking (bytes_ready=%d).\n",
+			inet_ntoa(client_port_to_check->address.sin_addr),
+			client_port_to_check->socket_fd, bytes_ready);
+		    client_port_to_check->blocking = 0;
+		    blocking_clients--;
+		}
+		handle_request(client_port_to_check);
+		continue;
 	    }
-	    client_port_to_check =
-		(CLIENT_TCP_PORT *) client_ports->get_next();
-	}
-	if (FD_ISSET(connection_socket, &read_fd_set)
-	    && ready_descriptors > 0) {
-	    ready_descriptors--;
 	    socklen_t client_address_length;
 	    new_client_port = new CLIENT_TCP_PORT();
 	    client_address_length = sizeof(new_client_port->address);
 	    new_client_port->socket_fd = accept(connection_socket,
 		(struct sockaddr *)
 		&new_client_port->address, &client_address_length);
-	    current_clients++;
-	    if (current_clients > max_clients) {
-		max_clients = current_clients;
-	    }
 	    if (new_client_port->socket_fd < 0) {
 		rcs_print_error("server: accept error -- %d %s \n", errno,
 		    strerror(errno));
+		delete new_client_port;
 		continue;
 	    }
+	    current_clients++;
+	    if (current_clients > max_clients) {
+		max_clients = current_clients;
+	    }
 	    rcs_print_debug(PRINT_SOCKET_CONNECT,
 		"Socket opened by host with IP address %s.\n",
 		inet_ntoa(new_client_port->address.sin_addr));
 	    new_client_port->serial_number = 0;
 	    new_client_port->blocking = 0;
-	    if (NULL != client_ports) {
+	    new_client_port->list_id =
 		client_ports->store_at_tail(new_client_port,
-		    sizeof(new_client_port), 0);
-	    }
-	    if (maxfdpl < new_client_port->socket_fd + 1) {
-		maxfdpl = new_client_port->socket_fd + 1;
+		sizeof(new_client_port), 0);
+	    ev.events = EPOLLIN;
+	    ev.data.ptr = new_client_port;
+	    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, new_client_port->socket_fd,
+		    &ev) < 0) {
+		rcs_print_error("epoll_ctl error: %d -- %s\n", errno,
+		    strerror(errno));
+		remove_client(new_client_port);
 	    }
-	    FD_SET(new_client_port->socket_fd, &read_fd_set);
-	} else {
-	    FD_SET(connection_socket, &read_fd_set);
 	}
-	if (0 != ready_descriptors) {
-	    rcs_print_error("%d descriptors ready but not serviced.\n",
-		ready_descriptors);
+	if (blocking_clients > 0) {
+	    service_blocking_reads();
+	}
+	if (polling_enabled && etime() >= next_poll_time) {
+	    update_subscriptions();
+	    next_poll_time = etime() + current_poll_interval_millis / 1000.0;
 	}
-	update_subscriptions();
     }
 }
 
-static int tcpsvr_handle_blocking_request_sigint_count = 0;
-static int tcpsvr_last_sig = 0;
-
-void tcpsvr_handle_blocking_request_sigint_handler(int sig)
-{
-    tcpsvr_last_sig = sig;
-    tcpsvr_handle_blocking_request_sigint_count++;
-}
-
 static void putbe32(char *addr, uint32_t val) {
     val = htonl(val);
     memcpy(addr, &val, sizeof(val));
@@ -523,128 +411,282 @@ static uint32_t getbe32(char *addr) {
     return ntohl(val);
 }
 
-#if defined(POSIX_THREADS) || defined(NO_THREADS)
-void *tcpsvr_handle_blocking_request(void *_req)
+/* Closes the connection and forgets everything the server kept for it.
+   The client must not be touched after this returns. */
+void CMS_SERVER_REMOTE_TCP_PORT::remove_client(CLIENT_TCP_PORT * clnt)
 {
-    signal(SIGINT, tcpsvr_handle_blocking_request_sigint_handler);
-    TCPSVR_BLOCKING_READ_REQUEST *blocking_read_req =
-	(TCPSVR_BLOCKING_READ_REQUEST *) _req;
-    char temp_buffer[0x2000];
-    if (_req == NULL) {
-	tcpsvr_threads_returned_early++;
-	return 0;
+    if (clnt->blocking) {
+	clnt->blocking = 0;
+	blocking_clients--;
     }
-    double dtimeout =
-	((double) (blocking_read_req->timeout_millis + 10)) / 1000.0;
-    if (dtimeout < 0) {
-	dtimeout = 600.0;
+    if (NULL != clnt->subscriptions) {
+	TCP_CLIENT_SUBSCRIPTION_INFO *clnt_sub_info =
+	    (TCP_CLIENT_SUBSCRIPTION_INFO *) clnt->subscriptions->get_head();
+	while (NULL != clnt_sub_info) {
+	    drop_subscription(clnt_sub_info);
+	    clnt->subscriptions->delete_current_node();
+	    clnt_sub_info =
+		(TCP_CLIENT_SUBSCRIPTION_INFO *) clnt->subscriptions->
+		get_next();
+	}
+	delete clnt->subscriptions;
+	clnt->subscriptions = NULL;
+	recalculate_polling_interval();
     }
-    if (dtimeout < 0.5) {
-	dtimeout = 0.5;
+    if (clnt->socket_fd >= 0) {
+	if (epoll_fd >= 0) {
+	    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, clnt->socket_fd, NULL);
+	}
+	close(clnt->socket_fd);
+	clnt->socket_fd = -1;
+	current_clients--;
     }
-    if (dtimeout > 600.0) {
-	dtimeout = 600.0;
+    client_ports->delete_node(clnt->list_id);
+    delete clnt;
+}
+
+/* How long epoll_wait() may sleep: until the next subscription update is
+   due, and no longer than a clock tick while blocking reads are parked. */
+int CMS_SERVER_REMOTE_TCP_PORT::poll_timeout_millis()
+{
+    int timeout_millis = -1;
+    if (polling_enabled) {
+	double time_left = next_poll_time - etime();
+	timeout_millis = (time_left > 0) ? ((int) (time_left * 1000.0) + 1) : 0;
     }
-    CLIENT_TCP_PORT *_client_tcp_port = blocking_read_req->_client_tcp_port;
-    CMS_SERVER *server = blocking_read_req->server;
+    if (blocking_clients > 0) {
+	int tick_millis = (int) (clk_tck() * 1000.0);
+	if (tick_millis < 1) {
+	    tick_millis = 1;
+	}
+	if (timeout_millis < 0 || tick_millis < timeout_millis) {
+	    timeout_millis = tick_millis;
+	}
+    }
+    return timeout_millis;
+}
 
-    if (NULL == server || NULL == _client_tcp_port) {
-	tcpsvr_threads_returned_early++;
-	return 0;
+/* Puts the reply header and, if it fits, the encoded data into temp_buffer
+   with a zero serial number.  Returns the number of bytes to send. */
+int CMS_SERVER_REMOTE_TCP_PORT::fill_read_reply(REMOTE_READ_REPLY * reply)
+{
+    putbe32(temp_buffer, 0);
+    putbe32(temp_buffer + 4, reply->status);
+    putbe32(temp_buffer + 8, reply->size);
+    putbe32(temp_buffer + 12, reply->write_id);
+    putbe32(temp_buffer + 16, reply->was_read);
+    if (reply->size < (0x2000 - 20) && reply->size > 0) {
+	memcpy(temp_buffer + 20, reply->data, reply->size);
+	return 20 + reply->size;
     }
-    memset(temp_buffer, 0, 0x2000);
-    REMOTE_BLOCKING_READ_REPLY *read_reply;
+    return 20;
+}
 
-    if (NULL != _client_tcp_port->diag_info) {
-	_client_tcp_port->diag_info->buffer_number =
-	    blocking_read_req->buffer_number;
-	server->set_diag_info(_client_tcp_port->diag_info);
-    } else if (server->diag_enabled) {
-	server->reset_diag_info(blocking_read_req->buffer_number);
+/* Sends a reply built by fill_read_reply() to one client, so one encoded
+   message can go out to any number of clients. */
+int CMS_SERVER_REMOTE_TCP_PORT::send_read_reply(CLIENT_TCP_PORT * clnt,
+    REMOTE_READ_REPLY * reply, int frame_size)
+{
+    putbe32(temp_buffer, clnt->serial_number);
+    if (sendn(clnt->socket_fd, temp_buffer, frame_size, 0, dtimeout) < 0) {
+	clnt->errors++;
+	return -1;
     }
+    if (frame_size == 20 && reply->size > 0) {
+	if (sendn(clnt->socket_fd, reply->data, reply->size, 0,
+		dtimeout) < 0) {
+	    clnt->errors++;
+	    return -1;
+	}
+    }
+    return 0;
+}
 
-    read_reply = (REMOTE_BLOCKING_READ_REPLY *)
-	server->process_request(blocking_read_req);
-    blocking_read_req->read_reply = read_reply;
-    if (NULL == read_reply) {
-	_client_tcp_port->blocking = 0;
-	rcs_print_error("Server could not process request.\n");
-	putbe32(temp_buffer, _client_tcp_port->serial_number);
-	putbe32(temp_buffer + 4, CMS_SERVER_SIDE_ERROR);
-	putbe32(temp_buffer + 8, 0);	/* size */
-	putbe32(temp_buffer + 12, 0)	/* write_id */;
-	putbe32(temp_buffer + 16, 0)	/* was_read */;
-	sendn(_client_tcp_port->socket_fd, temp_buffer, 20, 0, dtimeout);
-	_client_tcp_port->errors++;
-	_client_tcp_port->blocking_read_req = NULL;
-	delete blocking_read_req;
-	_client_tcp_port->threadId = 0;
-	tcpsvr_threads_returned_early++;
-	return 0;
+/* Sends a read reply for a buffer configured with "delta": a delta against
+   the message the client last got from us if it says it still has it, else
+   a key frame every keyframe_interval messages.  The encoding is kept, so
+   clients with the same reference share it. */
+int CMS_SERVER_REMOTE_TCP_PORT::send_delta_reply(CLIENT_TCP_PORT * clnt,
+    long buffer_number, REMOTE_READ_REPLY * reply, unsigned long acked_id,
+    int keyframe_interval)
+{
+    if (reply->size < 1 || NULL == reply->data) {
+	return send_read_reply(clnt, reply, fill_read_reply(reply));
     }
-    putbe32(temp_buffer, _client_tcp_port->serial_number);
-    putbe32(temp_buffer + 4, read_reply->status);
-    putbe32(temp_buffer + 8, read_reply->size);
-    putbe32(temp_buffer + 12, read_reply->write_id);
-    putbe32(temp_buffer + 16, read_reply->was_read);
-    if (read_reply->size < (0x2000 - 20) && read_reply->size > 0) {
-	memcpy(temp_buffer + 20, read_reply->data, read_reply->size);
-	_client_tcp_port->blocking = 0;
-	if (sendn
-	    (_client_tcp_port->socket_fd, temp_buffer, 20 + read_reply->size,
-		0, dtimeout) < 0) {
-	    _client_tcp_port->blocking = 0;
-	    _client_tcp_port->errors++;
-	    _client_tcp_port->blocking_read_req = NULL;
-	    delete blocking_read_req;
-	    _client_tcp_port->threadId = 0;
-	    tcpsvr_threads_returned_early++;
-	    return 0;
+    if (clnt->delta_ref_alloc < reply->size) {
+	char *new_ref = (char *) realloc(clnt->delta_ref, reply->size);
+	if (NULL == new_ref) {
+	    rcs_print_error("Can not allocate delta reference.\n");
+	    clnt->errors++;
+	    return -1;
 	}
-    } else {
-	_client_tcp_port->blocking = 0;
-	if (sendn(_client_tcp_port->socket_fd, temp_buffer, 20, 0, dtimeout) <
-	    0) {
-	    _client_tcp_port->blocking = 0;
-	    _client_tcp_port->errors++;
-	    _client_tcp_port->blocking_read_req = NULL;
-	    delete blocking_read_req;
-	    _client_tcp_port->threadId = 0;
-	    tcpsvr_threads_returned_early++;
-	    return 0;
+	clnt->delta_ref = new_ref;
+	clnt->delta_ref_alloc = reply->size;
+    }
+    if (delta_frame_alloc < 20 + reply->size + TCPDELTA_HEADER_SIZE) {
+	char *new_frame = (char *) realloc(delta_frame,
+	    20 + reply->size + TCPDELTA_HEADER_SIZE);
+	if (NULL == new_frame) {
+	    rcs_print_error("Can not allocate delta frame.\n");
+	    clnt->errors++;
+	    return -1;
 	}
-	if (read_reply->size > 0) {
-	    if (sendn
-		(_client_tcp_port->socket_fd, read_reply->data,
-		    read_reply->size, 0, dtimeout) < 0) {
-		_client_tcp_port->blocking = 0;
-		_client_tcp_port->errors++;
-		_client_tcp_port->blocking_read_req = NULL;
-		delete blocking_read_req;
-		_client_tcp_port->threadId = 0;
-		tcpsvr_threads_returned_early++;
-		return 0;
+	delta_frame = new_frame;
+	delta_frame_alloc = 20 + reply->size + TCPDELTA_HEADER_SIZE;
+	delta_frame_size = -1;
+    }
+
+    unsigned long base_id = 0;
+    if (clnt->delta_buffer_number == buffer_number && acked_id != 0 &&
+	clnt->delta_ref_id == acked_id &&
+	clnt->delta_count < keyframe_interval) {
+	base_id = acked_id;
+    }
+    if (delta_frame_size < 0 || delta_frame_buffer != buffer_number ||
+	delta_frame_write_id != (unsigned long) reply->write_id ||
+	delta_frame_base_id != base_id) {
+	delta_frame_size = tcpdelta_encode(base_id ? clnt->delta_ref : NULL,
+	    clnt->delta_ref_size, base_id, reply->data, reply->size,
+	    delta_frame + 20);
+	delta_frame_buffer = buffer_number;
+	delta_frame_write_id = reply->write_id;
+	delta_frame_base_id = base_id;
+    }
+    putbe32(delta_frame, clnt->serial_number);
+    putbe32(delta_frame + 4, reply->status);
+    putbe32(delta_frame + 8, delta_frame_size);
+    putbe32(delta_frame + 12, reply->write_id);
+    putbe32(delta_frame + 16, reply->was_read);
+    if (sendn(clnt->socket_fd, delta_frame, 20 + delta_frame_size, 0,
+	    dtimeout) < 0) {
+	clnt->errors++;
+	return -1;
+    }
+    memcpy(clnt->delta_ref, reply->data, reply->size);
+    clnt->delta_ref_size = reply->size;
+    clnt->delta_ref_id = reply->write_id;
+    clnt->delta_buffer_number = buffer_number;
+    clnt->delta_count = base_id ? clnt->delta_count + 1 : 0;
+    return 0;
+}
+
+static int same_blocking_read(TCPSVR_BLOCKING_READ_REQUEST * a,
+    TCPSVR_BLOCKING_READ_REQUEST * b)
+{
+    return (a->buffer_number == b->buffer_number &&
+	a->subdiv == b->subdiv && a->access_type == b->access_type);
+}
+
+/* Answers the parked blocking reads that have new data or have timed out.
+   Clients waiting on the same buffer share one read of it. */
+void CMS_SERVER_REMOTE_TCP_PORT::service_blocking_reads()
+{
+    pid_t pid = getpid();
+    pid_t tid = 0;
+    CMS_SERVER *server;
+    server = find_server(pid, tid);
+    if (NULL == server) {
+	rcs_print_error
+	    ("CMS_SERVER_REMOTE_TCP_PORT::service_blocking_reads Cannot find server object for pid = %d.\n",
+	    pid);
+	return;
+    }
+    if (waiting_clients_size < blocking_clients) {
+	CLIENT_TCP_PORT **new_waiting_clients = (CLIENT_TCP_PORT **)
+	    realloc(waiting_clients,
+	    blocking_clients * 2 * sizeof(CLIENT_TCP_PORT *));
+	if (NULL == new_waiting_clients) {
+	    rcs_print_error("Can not allocate list of blocking clients.\n");
+	    return;
+	}
+	waiting_clients = new_waiting_clients;
+	waiting_clients_size = blocking_clients * 2;
+    }
+    int num_waiting = 0;
+    CLIENT_TCP_PORT *clnt = (CLIENT_TCP_PORT *) client_ports->get_head();
+    while (NULL != clnt && num_waiting < waiting_clients_size) {
+	if (clnt->blocking && NULL != clnt->blocking_read_req) {
+	    waiting_clients[num_waiting++] = clnt;
+	}
+	clnt = (CLIENT_TCP_PORT *) client_ports->get_next();
+    }
+
+    double cur_time = etime();
+    char short_reply[20];
+    for (int i = 0; i < num_waiting; i++) {
+	if (NULL == waiting_clients[i]) {
+	    continue;
+	}
+	TCPSVR_BLOCKING_READ_REQUEST *req =
+	    waiting_clients[i]->blocking_read_req;
+	long min_last_id = req->last_id_read;
+	for (int j = i + 1; j < num_waiting; j++) {
+	    if (NULL != waiting_clients[j] &&
+		same_blocking_read(req, waiting_clients[j]->blocking_read_req)
+		&& waiting_clients[j]->blocking_read_req->last_id_read <
+		min_last_id) {
+		min_last_id = waiting_clients[j]->blocking_read_req->last_id_read;
+	    }
+	}
+	server->read_req.buffer_number = req->buffer_number;
+	server->read_req.access_type = req->access_type;
+	server->read_req.last_id_read = min_last_id;
+	server->read_req.subdiv = req->subdiv;
+	server->read_reply =
+	    (REMOTE_READ_REPLY *) server->process_request(&server->read_req);
+	int frame_size = 0;
+	if (NULL != server->read_reply &&
+	    server->read_reply->status != CMS_READ_OLD) {
+	    frame_size = fill_read_reply(server->read_reply);
+	}
+	int keyframe_interval =
+	    server->get_delta_keyframe_interval(req->buffer_number);
+	for (int j = i; j < num_waiting; j++) {
+	    clnt = waiting_clients[j];
+	    if (NULL == clnt ||
+		!same_blocking_read(req, clnt->blocking_read_req)) {
+		continue;
 	    }
+	    TCPSVR_BLOCKING_READ_REQUEST *clnt_req = clnt->blocking_read_req;
+	    waiting_clients[j] = NULL;
+	    if (NULL == server->read_reply) {
+		rcs_print_error("Server could not process request.\n");
+		putbe32(short_reply, clnt->serial_number);
+		putbe32(short_reply + 4, CMS_SERVER_SIDE_ERROR);
+		putbe32(short_reply + 8, 0);	/* size */
+		putbe32(short_reply + 12, 0);	/* write_id */
+		putbe32(short_reply + 16, 0);	/* was_read */
+		sendn(clnt->socket_fd, short_reply, 20, 0, dtimeout);
+		clnt->errors++;
+	    } else if (frame_size > 0 && (server->read_reply->status < 0 ||
+		    server->read_reply->write_id != clnt_req->last_id_read)) {
+		if (keyframe_interval > 0) {
+		    send_delta_reply(clnt, req->buffer_number,
+			server->read_reply, clnt_req->last_id_read,
+			keyframe_interval);
+		} else {
+		    send_read_reply(clnt, server->read_reply, frame_size);
+		}
+	    } else if (clnt_req->deadline >= 0.0
+		&& cur_time >= clnt_req->deadline) {
+		putbe32(short_reply, clnt->serial_number);
+		putbe32(short_reply + 4, CMS_TIMED_OUT);
+		putbe32(short_reply + 8, 0);	/* size */
+		putbe32(short_reply + 12, clnt_req->last_id_read);
+		putbe32(short_reply + 16, 0);	/* was_read */
+		sendn(clnt->socket_fd, short_reply, 20, 0, dtimeout);
+	    } else {
+		continue;
+	    }
+	    clnt->blocking = 0;
+	    blocking_clients--;
 	}
     }
-    _client_tcp_port->blocking_read_req = NULL;
-    delete blocking_read_req;
-    _client_tcp_port->threadId = 0;
-    tcpsvr_threads_exited++;
-#ifdef POSIX_THREADS
-    pthread_exit(0);
-#endif
-#ifdef NO_THREADS
-    exit(0);
-#endif
 }
 
-#endif
-
 void CMS_SERVER_REMOTE_TCP_PORT::handle_request(CLIENT_TCP_PORT *
     _client_tcp_port)
 {
-    CLIENT_TCP_PORT *client_port_to_check = NULL;
     pid_t pid = getpid();
     pid_t tid = 0;
     CMS_SERVER *server;
@@ -663,20 +705,8 @@ void CMS_SERVER_REMOTE_TCP_PORT::handle_request(CLIENT_TCP_PORT *
     if (_client_tcp_port->errors >= _client_tcp_port->max_errors) {
 	rcs_print_error("Too many errors - closing connection(%d)\n",
 	    _client_tcp_port->socket_fd);
-	client_port_to_check = (CLIENT_TCP_PORT *) client_ports->get_head();
-	while (NULL != client_port_to_check) {
-	    if (client_port_to_check->socket_fd ==
-		_client_tcp_port->socket_fd) {
-		delete client_port_to_check;
-		client_ports->delete_current_node();
-	    }
-	    client_port_to_check =
-		(CLIENT_TCP_PORT *) client_ports->get_next();
-	}
-	close(_client_tcp_port->socket_fd);
-	current_clients--;
-	FD_CLR(_client_tcp_port->socket_fd, &read_fd_set);
-	_client_tcp_port->socket_fd = -1;
+	remove_client(_client_tcp_port);
+	return;
     }
 
     if (recvn(_client_tcp_port->socket_fd, temp_buffer, 20, 0, -1, NULL) < 0) {
@@ -713,6 +743,9 @@ void CMS_SERVER_REMOTE_TCP_PORT::handle_request(CLIENT_TCP_PORT *
 
     switch_function(_client_tcp_port,
 	server, request_type, buffer_number, received_serial_number);
+    if (request_type == REMOTE_CMS_CLOSE_CHANNEL_REQUEST_TYPE) {
+	return;			/* _client_tcp_port has been deleted */
+    }
 
     if (NULL != _client_tcp_port->diag_info &&
 	NULL != server->last_local_port_used && server->diag_enabled) {
@@ -733,7 +766,7 @@ void CMS_SERVER_REMOTE_TCP_PORT::switch_function(CLIENT_TCP_PORT *
     long request_type, long buffer_number, long received_serial_number)
 {
     int total_subdivisions = 1;
-    CLIENT_TCP_PORT *client_port_to_check = NULL;
+    int keyframe_interval = 0;
     switch (request_type) {
     case REMOTE_CMS_SET_DIAG_INFO_REQUEST_TYPE:
 	{
@@ -956,6 +989,9 @@ void CMS_SERVER_REMOTE_TCP_PORT::switch_function(CLIENT_TCP_PORT *
 	{
 	    REMOTE_GET_BUF_NAME_REQUEST namereq;
 	    namereq.buffer_number = buffer_number;
+	    if (getbe32(temp_buffer + 12) == REMOTE_CMS_ABI_MAGIC) {
+		namereq.abi_signature = getbe32(temp_buffer + 16);
+	    }
 	    REMOTE_GET_BUF_NAME_REPLY *namereply = NULL;
 	    namereply =
 		(REMOTE_GET_BUF_NAME_REPLY *) server->
@@ -986,23 +1022,20 @@ void CMS_SERVER_REMOTE_TCP_PORT::switch_function(CLIENT_TCP_PORT *
 
     case REMOTE_CMS_BLOCKING_READ_REQUEST_TYPE:
 	{
-	    TCPSVR_BLOCKING_READ_REQUEST *blocking_read_req;
-
-#ifdef NO_THREADS
+	    /* The read is parked on the client and answered from run()
+	       once the buffer changes or the timeout expires. */
 	    if (NULL == _client_tcp_port->blocking_read_req) {
 		_client_tcp_port->blocking_read_req =
 		    new TCPSVR_BLOCKING_READ_REQUEST();
 	    }
-	    blocking_read_req = _client_tcp_port->blocking_read_req;
-#else
-	    blocking_read_req;
-	    = new TCPSVR_BLOCKING_READ_REQUEST();
-#endif
+	    TCPSVR_BLOCKING_READ_REQUEST *blocking_read_req =
+		_client_tcp_port->blocking_read_req;
 	    blocking_read_req->buffer_number = buffer_number;
 	    blocking_read_req->access_type =
 		ntohl(*((uint32_t *) temp_buffer + 3));
 	    blocking_read_req->last_id_read =
 		ntohl(*((uint32_t *) temp_buffer + 4));
+	    blocking_read_req->subdiv = 0;
 	    total_subdivisions = 1;
 	    if (max_total_subdivisions > 1) {
 		total_subdivisions =
@@ -1036,77 +1069,17 @@ void CMS_SERVER_REMOTE_TCP_PORT::switch_function(CLIENT_TCP_PORT *
 		}
 	    }
 	    blocking_read_req->timeout_millis =
-		ntohl(*((uint32_t *) temp_buffer + 5));
-	    blocking_read_req->server = server;
-	    blocking_read_req->remport = this;
-	    _client_tcp_port->blocking = 1;
-	    blocking_read_req->_client_tcp_port = _client_tcp_port;
-#ifdef POSIX_THREADS
-	    int thr_retval = pthread_create(&(_client_tcp_port->threadId),	/* ptr to new-thread-id */
-		NULL,		// pthread_attr_t *, ptr to attributes
-		tcpsvr_handle_blocking_request,	// start_func
-		blocking_read_req	// arg for start_func
-		);
-	    if (thr_retval != 0) {
-		_client_tcp_port->blocking = 0;
-		rcs_print_error("pthread_create error: thr_retval = %d\n",
-		    thr_retval);
-		rcs_print_error("pthread_create error: %d %s\n", errno,
-		    strerror(errno));
-		*((uint32_t *) temp_buffer) =
-		    htonl(_client_tcp_port->serial_number);
-		*((uint32_t *) temp_buffer + 1) =
-		    htonl((unsigned long) CMS_SERVER_SIDE_ERROR);
-		putbe32(temp_buffer + 8, 0);	/* size */
-		putbe32(temp_buffer + 12, 0);	/* write_id */
-		putbe32(temp_buffer + 16, 0);	/* was_read */
-		sendn(_client_tcp_port->socket_fd, temp_buffer, 20, 0,
-		    dtimeout);
-		return;
-	    }
-#else
-#ifdef NO_THREADS
-	    int fork_ret = fork();
-	    switch (fork_ret) {
-	    case 0:		// child
-		_client_tcp_port->threadId = getpid();
-		tcpsvr_handle_blocking_request(blocking_read_req);
-		exit(0);
-		break;
-
-	    case -1:		// Error
-		rcs_print_error("fork error: %d %s\n", errno,
-		    strerror(errno));
-		_client_tcp_port->blocking = 0;
-		putbe32(temp_buffer, _client_tcp_port->serial_number);
-		putbe32(temp_buffer + 4, CMS_SERVER_SIDE_ERROR);
-		putbe32(temp_buffer + 8, 0);
-		putbe32(temp_buffer + 12, 0);
-		putbe32(temp_buffer + 16, 0);
-		sendn(_client_tcp_port->socket_fd, temp_buffer, 20, 0,
-		    dtimeout);
-		break;
-
-	    default:		// parent;
-		_client_tcp_port->threadId = fork_ret;
-		break;
+		(int32_t) ntohl(*((uint32_t *) temp_buffer + 5));
+	    if (blocking_read_req->timeout_millis < 0) {
+		blocking_read_req->deadline = -1.0;
+	    } else {
+		blocking_read_req->deadline = etime() +
+		    blocking_read_req->timeout_millis / 1000.0;
 	    }
-#else
-	    rcs_print_error
-		("Blocking read not supported on this platform.\n");
-	    *((uint32_t *) temp_buffer) =
-		htonl(_client_tcp_port->serial_number);
-	    *((uint32_t *) temp_buffer + 1) =
-		htonl((unsigned long) CMS_SERVER_SIDE_ERROR);
-	    putbe32(temp_buffer + 8, 0);	/* size */
-	    putbe32(temp_buffer + 12, 0);	/* write_id */
-	    putbe32(temp_buffer + 16, 0);	/* was_read */
-	    sendn(_client_tcp_port->socket_fd, temp_buffer, 20, 0, dtimeout);
-	    return;
-
-#endif
-#endif
-	    tcpsvr_threads_created++;
+	    _client_tcp_port->blocking = 1;
+	    blocking_clients++;
+	    /* Answer at once if the buffer is already newer. */
+	    service_blocking_reads();
 	}
 	break;
 
@@ -1114,8 +1087,6 @@ void CMS_SERVER_REMOTE_TCP_PORT::switch_function(CLIENT_TCP_PORT *
 	server->read_req.buffer_number = buffer_number;
 	server->read_req.access_type = ntohl(*((uint32_t *) temp_buffer + 3));
 	server->read_req.last_id_read = ntohl(*((uint32_t *) temp_buffer + 4));
-	server->read_reply =
-	    (REMOTE_READ_REPLY *) server->process_request(&server->read_req);
 	if (max_total_subdivisions > 1) {
 	    total_subdivisions =
 		server->get_total_subdivisions(buffer_number);
@@ -1136,6 +1107,8 @@ void CMS_SERVER_REMOTE_TCP_PORT::switch_function(CLIENT_TCP_PORT *
 	} else {
 	    server->read_req.subdiv = 0;
 	}
+	server->read_reply =
+	    (REMOTE_READ_REPLY *) server->process_request(&server->read_req);
 	if (NULL == server->read_reply) {
 	    rcs_print_error("Server could not process request.\n");
 	    putbe32(temp_buffer, _client_tcp_port->serial_number);
@@ -1146,36 +1119,14 @@ void CMS_SERVER_REMOTE_TCP_PORT::switch_function(CLIENT_TCP_PORT *
 	    sendn(_client_tcp_port->socket_fd, temp_buffer, 20, 0, dtimeout);
 	    return;
 	}
-	putbe32(temp_buffer, _client_tcp_port->serial_number);
-	putbe32(temp_buffer + 4, server->read_reply->status);
-	putbe32(temp_buffer + 8, server->read_reply->size);
-	putbe32(temp_buffer + 12, server->read_reply->write_id);
-	putbe32(temp_buffer + 16, server->read_reply->was_read);
-	if (server->read_reply->size < (0x2000 - 20)
-	    && server->read_reply->size > 0) {
-	    memcpy(temp_buffer + 20, server->read_reply->data,
-		server->read_reply->size);
-	    if (sendn
-		(_client_tcp_port->socket_fd, temp_buffer,
-		    20 + server->read_reply->size, 0, dtimeout) < 0) {
-		_client_tcp_port->errors++;
-		return;
-	    }
+	keyframe_interval = server->get_delta_keyframe_interval(buffer_number);
+	if (keyframe_interval > 0) {
+	    send_delta_reply(_client_tcp_port, buffer_number,
+		server->read_reply, server->read_req.last_id_read,
+		keyframe_interval);
 	} else {
-	    if (sendn
-		(_client_tcp_port->socket_fd, temp_buffer, 20, 0,
-		    dtimeout) < 0) {
-		_client_tcp_port->errors++;
-		return;
-	    }
-	    if (server->read_reply->size > 0) {
-		if (sendn
-		    (_client_tcp_port->socket_fd, server->read_reply->data,
-			server->read_reply->size, 0, dtimeout) < 0) {
-		    _client_tcp_port->errors++;
-		    return;
-		}
-	    }
+	    send_read_reply(_client_tcp_port, server->read_reply,
+		fill_read_reply(server->read_reply));
 	}
 	break;
 
@@ -1372,24 +1323,7 @@ void CMS_SERVER_REMOTE_TCP_PORT::switch_function(CLIENT_TCP_PORT *
 	break;
 
     case REMOTE_CMS_CLOSE_CHANNEL_REQUEST_TYPE:
-	client_port_to_check = (CLIENT_TCP_PORT *) client_ports->get_head();
-	while (NULL != client_port_to_check) {
-	    if (client_port_to_check->socket_fd ==
-		_client_tcp_port->socket_fd) {
-		break;
-	    }
-	    client_port_to_check =
-		(CLIENT_TCP_PORT *) client_ports->get_next();
-	}
-	FD_CLR(_client_tcp_port->socket_fd, &read_fd_set);
-	close(_client_tcp_port->socket_fd);
-	current_clients--;
-	if (NULL != _client_tcp_port->subscriptions) {
-	    remove_subscription_client(_client_tcp_port, buffer_number);
-	}
-	_client_tcp_port->socket_fd = -1;
-	delete _client_tcp_port;
-	client_ports->delete_current_node();
+	remove_client(_client_tcp_port);
 	break;
 
     case REMOTE_CMS_GET_KEYS_REQUEST_TYPE:
@@ -1554,7 +1488,8 @@ void CMS_SERVER_REMOTE_TCP_PORT::add_subscription_client(int buffer_number,
 	temp_clnt_info->subscription_list_id =
 	    clnt->subscriptions->store_at_tail(temp_clnt_info,
 	    sizeof(*temp_clnt_info), 0);
-	buf_info->sub_clnt_info->store_at_tail(temp_clnt_info,
+	temp_clnt_info->buf_list_id =
+	    buf_info->sub_clnt_info->store_at_tail(temp_clnt_info,
 	    sizeof(*temp_clnt_info), 0);
     }
     temp_clnt_info->subscription_type = subscription_type;
@@ -1565,27 +1500,15 @@ void CMS_SERVER_REMOTE_TCP_PORT::add_subscription_client(int buffer_number,
 void CMS_SERVER_REMOTE_TCP_PORT::remove_subscription_client(CLIENT_TCP_PORT *
     clnt, int buffer_number)
 {
+    if (NULL == clnt->subscriptions) {
+	return;
+    }
     TCP_CLIENT_SUBSCRIPTION_INFO *temp_clnt_info =
 	(TCP_CLIENT_SUBSCRIPTION_INFO *) clnt->subscriptions->get_head();
     while (temp_clnt_info != NULL) {
 	if (temp_clnt_info->buffer_number == buffer_number) {
-	    if (NULL != temp_clnt_info->sub_buf_info) {
-		if (NULL != temp_clnt_info->sub_buf_info->sub_clnt_info) {
-		    temp_clnt_info->sub_buf_info->sub_clnt_info->
-			delete_node(temp_clnt_info->subscription_list_id);
-		    if (temp_clnt_info->sub_buf_info->sub_clnt_info->
-			list_size == 0) {
-			subscription_buffers->delete_node(temp_clnt_info->
-			    sub_buf_info->list_id);
-			delete temp_clnt_info->sub_buf_info->sub_clnt_info;
-			temp_clnt_info->sub_buf_info->sub_clnt_info = NULL;
-			delete temp_clnt_info->sub_buf_info;
-			temp_clnt_info->sub_buf_info = NULL;
-		    }
-		}
-	    }
-	    delete temp_clnt_info;
-	    temp_clnt_info = NULL;
+	    drop_subscription(temp_clnt_info);
+	    clnt->subscriptions->delete_current_node();
 	    break;
 	}
 	temp_clnt_info =
@@ -1594,10 +1517,33 @@ void CMS_SERVER_REMOTE_TCP_PORT::remove_subscription_client(CLIENT_TCP_PORT *
     recalculate_polling_interval();
 }
 
+/* Unlinks one subscription from its buffer, deleting the buffer's entry
+   when it was the last subscriber, and deletes it.  The caller removes it
+   from the client's list. */
+void CMS_SERVER_REMOTE_TCP_PORT::drop_subscription(TCP_CLIENT_SUBSCRIPTION_INFO
+    * clnt_info)
+{
+    TCP_BUFFER_SUBSCRIPTION_INFO *buf_info = clnt_info->sub_buf_info;
+    if (NULL != buf_info && NULL != buf_info->sub_clnt_info) {
+	buf_info->sub_clnt_info->delete_node(clnt_info->buf_list_id);
+	if (buf_info->sub_clnt_info->list_size < 1) {
+	    if (NULL != subscription_buffers) {
+		subscription_buffers->delete_node(buf_info->list_id);
+	    }
+	    delete buf_info;
+	}
+    }
+    clnt_info->sub_buf_info = NULL;
+    delete clnt_info;
+}
+
 void CMS_SERVER_REMOTE_TCP_PORT::recalculate_polling_interval()
 {
     int min_poll_interval_millis = 30000;
     polling_enabled = 0;
+    if (NULL == subscription_buffers) {
+	return;
+    }
     TCP_BUFFER_SUBSCRIPTION_INFO *buf_info =
 	(TCP_BUFFER_SUBSCRIPTION_INFO *) subscription_buffers->get_head();
     while (NULL != buf_info) {
@@ -1607,8 +1553,10 @@ void CMS_SERVER_REMOTE_TCP_PORT::recalculate_polling_interval()
 	while (temp_clnt_info != NULL) {
 	    if (temp_clnt_info->poll_interval_millis <
 		min_poll_interval_millis
-		&& temp_clnt_info->subscription_type ==
-		CMS_POLLED_SUBSCRIPTION) {
+		&& (temp_clnt_info->subscription_type ==
+		    CMS_POLLED_SUBSCRIPTION
+		    || temp_clnt_info->subscription_type ==
+		    CMS_VARIABLE_SUBSCRIPTION)) {
 		min_poll_interval_millis =
 		    temp_clnt_info->poll_interval_millis;
 		polling_enabled = 1;
@@ -1624,12 +1572,14 @@ void CMS_SERVER_REMOTE_TCP_PORT::recalculate_polling_interval()
     } else {
 	current_poll_interval_millis = ((int) (clk_tck() * 1000.0));
     }
-    select_timeout.tv_sec = current_poll_interval_millis / 1000;
-    select_timeout.tv_usec = (current_poll_interval_millis % 1000) * 1000;
     dtimeout = (current_poll_interval_millis + 10) * 1000.0;
     if (dtimeout < 0.5) {
 	dtimeout = 0.5;
     }
+    double poll_due = etime() + current_poll_interval_millis / 1000.0;
+    if (next_poll_time > poll_due) {
+	next_poll_time = poll_due;
+    }
 }
 
 void CMS_SERVER_REMOTE_TCP_PORT::update_subscriptions()
@@ -1668,11 +1618,10 @@ void CMS_SERVER_REMOTE_TCP_PORT::update_subscriptions()
 		subscription_buffers->get_next();
 	    continue;
 	}
-	putbe32(temp_buffer, 0);
-	putbe32(temp_buffer + 4, server->read_reply->status);
-	putbe32(temp_buffer + 8, server->read_reply->size);
-	putbe32(temp_buffer + 12, server->read_reply->write_id);
-	putbe32(temp_buffer + 16, server->read_reply->was_read);
+	/* Encoded once, sent to every subscriber that is due. */
+	int frame_size = fill_read_reply(server->read_reply);
+	int keyframe_interval =
+	    server->get_delta_keyframe_interval(buf_info->buffer_number);
 	TCP_CLIENT_SUBSCRIPTION_INFO *temp_clnt_info =
 	    (TCP_CLIENT_SUBSCRIPTION_INFO *) buf_info->sub_clnt_info->
 	    get_head();
@@ -1692,31 +1641,16 @@ void CMS_SERVER_REMOTE_TCP_PORT::update_subscriptions()
 		temp_clnt_info->last_id_read = server->read_reply->write_id;
 		temp_clnt_info->last_sub_sent_time = cur_time;
 		temp_clnt_info->clnt_port->serial_number++;
-		putbe32(temp_buffer, temp_clnt_info->clnt_port->serial_number);
-		if (server->read_reply->size < 0x2000 - 20
-		    && server->read_reply->size > 0) {
-		    memcpy(temp_buffer + 20, server->read_reply->data,
-			server->read_reply->size);
-		    if (sendn
-			(temp_clnt_info->clnt_port->socket_fd, temp_buffer,
-			    20 + server->read_reply->size, 0, dtimeout) < 0) {
-			temp_clnt_info->clnt_port->errors++;
-			return;
-		    }
+		if (keyframe_interval > 0) {
+		    /* Replies arrive in order, so the client has what it
+		       was sent last. */
+		    send_delta_reply(temp_clnt_info->clnt_port,
+			buf_info->buffer_number, server->read_reply,
+			temp_clnt_info->clnt_port->delta_ref_id,
+			keyframe_interval);
 		} else {
-		    if (sendn(temp_clnt_info->clnt_port->socket_fd,
-			    temp_buffer, 20, 0, dtimeout) < 0) {
-			temp_clnt_info->clnt_port->errors++;
-			return;
-		    }
-		    if (server->read_reply->size > 0) {
-			if (sendn(temp_clnt_info->clnt_port->socket_fd,
-				server->read_reply->data,
-				server->read_reply->size, 0, dtimeout) < 0) {
-			    temp_clnt_info->clnt_port->errors++;
-			    return;
-			}
-		    }
+		    send_read_reply(temp_clnt_info->clnt_port,
+			server->read_reply, frame_size);
 		}
 	    }
 	    if (temp_clnt_info->last_id_read < buf_info->min_last_id) {
@@ -1755,6 +1689,7 @@ TCP_CLIENT_SUBSCRIPTION_INFO::TCP_CLIENT_SUBSCRIPTION_INFO()
     poll_interval_millis = 30000;
     last_sub_sent_time = 0.0;
     subscription_list_id = -1;
+    buf_list_id = -1;
     buffer_number = -1;
     subscription_paused = 0;
     last_id_read = 0;
@@ -1784,12 +1719,19 @@ CLIENT_TCP_PORT::CLIENT_TCP_PORT()
     address.sin_family = AF_INET;
     address.sin_addr.s_addr = htonl(INADDR_ANY);
     socket_fd = -1;
+    list_id = -1;
     subscriptions = NULL;
     tid = -1;
     pid = -1;
+    blocking = 0;
     blocking_read_req = NULL;
-    threadId = 0;
     diag_info = NULL;
+    delta_buffer_number = -1;
+    delta_ref = NULL;
+    delta_ref_size = 0;
+    delta_ref_alloc = 0;
+    delta_ref_id = 0;
+    delta_count = 0;
 }
 
 CLIENT_TCP_PORT::~CLIENT_TCP_PORT()
@@ -1809,14 +1751,16 @@ CLIENT_TCP_PORT::~CLIENT_TCP_PORT()
 	delete subscriptions;
 	subscriptions = NULL;
     }
-#ifdef NO_THREADS
     if (NULL != blocking_read_req) {
 	delete blocking_read_req;
 	blocking_read_req = NULL;
     }
-#endif
     if (NULL != diag_info) {
 	delete diag_info;
 	diag_info = NULL;
     }
+    if (NULL != delta_ref) {
+	free(delta_ref);
+	delta_ref = NULL;
+    }
 }
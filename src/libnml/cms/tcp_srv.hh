@@ -33,16 +33,10 @@ extern "C" {
 }
 #endif
 
-#ifndef NO_THREADS
-#define NO_THREADS
-
-#ifdef POSIX_THREADS
-#include <pthread.h>
-#endif
-#endif
-
 #define MAX_TCP_BUFFER_SIZE 16
+#define TCPSVR_MAX_EVENTS 64	/* events taken per epoll_wait() */
 class CLIENT_TCP_PORT;
+class TCP_CLIENT_SUBSCRIPTION_INFO;
 
 class CMS_SERVER_REMOTE_TCP_PORT:public CMS_SERVER_REMOTE_PORT {
   public:
@@ -54,9 +48,9 @@ class CMS_SERVER_REMOTE_TCP_PORT:public CMS_SERVER_REMOTE_PORT {
     void unregister_port();
     double dtimeout;
   protected:
-      fd_set read_fd_set, write_fd_set;
+    int epoll_fd;
     void handle_request(CLIENT_TCP_PORT *);
-    int maxfdpl;
+    void remove_client(CLIENT_TCP_PORT *);
     LinkedList *client_ports;
     LinkedList *subscription_buffers;
     int connection_socket;
@@ -66,12 +60,30 @@ class CMS_SERVER_REMOTE_TCP_PORT:public CMS_SERVER_REMOTE_PORT {
     char temp_buffer[0x2000];
     int current_poll_interval_millis;
     int polling_enabled;
-    struct timeval select_timeout;
+    double next_poll_time;
+    int blocking_clients;
+    CLIENT_TCP_PORT **waiting_clients;
+    int waiting_clients_size;
+    int poll_timeout_millis();
+    void service_blocking_reads();
+    int fill_read_reply(REMOTE_READ_REPLY * reply);
+    int send_read_reply(CLIENT_TCP_PORT * clnt, REMOTE_READ_REPLY * reply,
+	int frame_size);
+    char *delta_frame;		/* reply header and delta encoded data */
+    long delta_frame_alloc;
+    long delta_frame_size;	/* encoded bytes, or -1 if none cached */
+    long delta_frame_buffer;
+    unsigned long delta_frame_write_id;
+    unsigned long delta_frame_base_id;	/* 0 for a key frame */
+    int send_delta_reply(CLIENT_TCP_PORT * clnt, long buffer_number,
+	REMOTE_READ_REPLY * reply, unsigned long acked_id,
+	int keyframe_interval);
     void update_subscriptions();
     void add_subscription_client(int buffer_number, int subscription_type,
 	int poll_interval_millis, CLIENT_TCP_PORT * clnt);
     void remove_subscription_client(CLIENT_TCP_PORT * clnt,
 	int buffer_number);
+    void drop_subscription(TCP_CLIENT_SUBSCRIPTION_INFO * clnt_info);
     void recalculate_polling_interval();
     void switch_function(CLIENT_TCP_PORT *
 	_client_tcp_port,
@@ -96,7 +108,8 @@ class TCP_CLIENT_SUBSCRIPTION_INFO {
     int subscription_type;
     int poll_interval_millis;
     double last_sub_sent_time;
-    int subscription_list_id;
+    int subscription_list_id;	/* id in clnt_port->subscriptions */
+    int buf_list_id;		/* id in sub_buf_info->sub_clnt_info */
     int buffer_number;
     int subscription_paused;
     int last_id_read;
@@ -114,17 +127,19 @@ class CLIENT_TCP_PORT {
     int errors, max_errors;
     struct sockaddr_in address;
     int socket_fd;
+    int list_id;
     LinkedList *subscriptions;
     pid_t tid;
     pid_t pid;
     int blocking;
-#ifdef POSIX_THREADS
-    pthread_t threadId;
-#else
-    int threadId;
-#endif
     TCPSVR_BLOCKING_READ_REQUEST *blocking_read_req;
     REMOTE_SET_DIAG_INFO_REQUEST *diag_info;
+    long delta_buffer_number;	/* buffer delta_ref belongs to, or -1 */
+    char *delta_ref;		/* last message sent, as the client has it */
+    long delta_ref_size;
+    long delta_ref_alloc;
+    unsigned long delta_ref_id;
+    int delta_count;		/* deltas sent since the last key frame */
 
 };
 
@@ -132,10 +147,7 @@ class TCPSVR_BLOCKING_READ_REQUEST:public REMOTE_BLOCKING_READ_REQUEST {
   public:
     TCPSVR_BLOCKING_READ_REQUEST();
     ~TCPSVR_BLOCKING_READ_REQUEST();
-    CLIENT_TCP_PORT *_client_tcp_port;
-    CMS_SERVER_REMOTE_TCP_PORT *remport;
-    CMS_SERVER *server;
-    REMOTE_BLOCKING_READ_REPLY *read_reply;
+    double deadline;		/* etime() to give up at, or -1 */
 };
 
 #endif /* TCP_SRV_HH */
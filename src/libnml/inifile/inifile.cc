@@ -18,6 +18,11 @@
 #include <string.h>             /* strstr() */
 #include <ctype.h>              /* isspace() */
 #include <fcntl.h>
+#include <sys/stat.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
 
 
 #include "config.h"
@@ -51,6 +56,7 @@ IniFile::IniFile(int _errMask, FILE *_fp)
     fp = _fp;
     errMask = _errMask;
     owned = false;
+    index = NULL;
 
     if(fp != NULL)
         LockFile();
@@ -99,6 +105,7 @@ IniFile::Close()
 
         fp = NULL;
     }
+    index = NULL;
 
     return(rVal == 0);
 }
@@ -180,6 +187,192 @@ IniFile::Find(double *result, StrDoublePair *pPair,
 }
 
 
+/*! Parsed form of an INI file.
+
+   The file is read once into its logical lines (comments dropped,
+   backslash continuations joined) and every line of the form
+   "TAG = value" is indexed by tag, both for the whole file and for the
+   section it is in.  Lookups then follow the same rules as a scan of
+   the file: only the first [SECTION] of a name is searched, a section
+   ends at the next line starting with '[', and tags match up to the
+   first blank or '='.
+
+   Indexes are cached per file identity (device, inode, size and mtime)
+   and shared by all IniFile objects of the process, so Task, the
+   interpreter and every other reader open the same INI file many times
+   but parse it once.  They are never freed: the strings returned by
+   Find() stay valid after Close().
+
+   Files the index cannot represent exactly (ambiguous carriage returns,
+   too many continuation lines, a section header inside a continuation)
+   are left to the old line-by-line scan. */
+struct IniFile::Index {
+    struct Entry {
+        std::string             value;
+        bool                    hasValue;
+        unsigned int            lineNo;
+    };
+    typedef std::map<std::string, std::vector<size_t> > TagMap;
+    struct Section {
+        TagMap                  tags;
+        unsigned int            endLineNo;      /* line that ended the section */
+    };
+
+    std::vector<Entry>          entries;
+    TagMap                      tags;           /* section == NULL lookups */
+    std::map<std::string, Section> sections;
+    unsigned int                totalLines;
+
+    static const Index *        Get(FILE *fp);
+    static Index *              Parse(FILE *fp);
+};
+
+/* delimiters ending a tag, see the tagEnd test in ScanFind() */
+static bool is_tag_end(char c)
+{
+    return c == ' ' || c == '\r' || c == '\t' || c == '\n' || c == '=';
+}
+
+IniFile::Index *
+IniFile::Index::Parse(FILE *fp)
+{
+    char                        line[LINELEN + 2];
+    std::string                 logical;
+    int                         extend_ct = 0;
+    unsigned int                lineNo = 0;
+    Section                     *current = NULL;
+    Index                       *idx = new Index;
+
+    rewind(fp);
+    while (fgets(line, LINELEN + 1, fp) != NULL) {
+        if (check_line_endings(line)) {
+            delete idx;
+            return NULL;
+        }
+        lineNo++;
+
+        int newLinePos = strlen(line) - 1;
+        if (newLinePos < 0) {
+            newLinePos = 0;
+        }
+        if (line[newLinePos] == '\n') {
+            line[newLinePos] = 0;
+        }
+        bool extending = newLinePos > 0 && line[newLinePos-1] == '\\';
+        const char *first = SkipWhite(line);
+        if ((extend_ct || extending) && first && *first == '[') {
+            /* the scan matches section headers on raw lines */
+            delete idx;
+            return NULL;
+        }
+        if (extending) {
+            if (!extend_ct) {
+                logical.clear();
+            }
+            logical.append(line, newLinePos - 1);
+            if (++extend_ct > MAX_EXTEND_LINES) {
+                delete idx;
+                return NULL;
+            }
+            continue;
+        }
+        if (extend_ct) {
+            logical.append(line, newLinePos);
+        } else {
+            logical = line;
+        }
+        extend_ct = 0;
+
+        const char *nonWhite = SkipWhite(logical.c_str());
+        if (nonWhite == NULL) {
+            continue;
+        }
+
+        if (nonWhite[0] == '[') {
+            if (current) {
+                current->endLineNo = lineNo;
+            }
+            current = NULL;
+            const char *close = strchr(nonWhite, ']');
+            if (close) {
+                std::string name(nonWhite + 1, close - nonWhite - 1);
+                if (idx->sections.find(name) == idx->sections.end()) {
+                    current = &idx->sections[name];
+                }
+            }
+        }
+
+        size_t len = 0;
+        while (nonWhite[len] && !is_tag_end(nonWhite[len])) {
+            len++;
+        }
+        if (len == 0 || nonWhite[len] == 0) {
+            continue;
+        }
+
+        Entry e;
+        const char *valueString = AfterEqual(nonWhite + len);
+        e.hasValue = valueString != NULL;
+        e.lineNo = lineNo;
+        if (e.hasValue) {
+            e.value = valueString;
+            size_t end = e.value.find_last_not_of(" \t\r");
+            e.value.erase(end + 1);
+        }
+        std::string key(nonWhite, len);
+        idx->entries.push_back(e);
+        idx->tags[key].push_back(idx->entries.size() - 1);
+        if (current && nonWhite[0] != '[') {
+            current->tags[key].push_back(idx->entries.size() - 1);
+        }
+    }
+    if (extend_ct) {
+        /* unterminated continuation at EOF, leave it to the scan */
+        delete idx;
+        return NULL;
+    }
+    if (current) {
+        current->endLineNo = lineNo;
+    }
+    idx->totalLines = lineNo;
+    return idx;
+}
+
+const IniFile::Index *
+IniFile::Index::Get(FILE *fp)
+{
+    struct FileId {
+        dev_t dev; ino_t ino; off_t size; time_t sec; long nsec;
+        bool operator<(const FileId &o) const {
+            if (dev != o.dev) return dev < o.dev;
+            if (ino != o.ino) return ino < o.ino;
+            if (size != o.size) return size < o.size;
+            if (sec != o.sec) return sec < o.sec;
+            return nsec < o.nsec;
+        }
+    };
+    static std::mutex           cacheLock;
+    static std::map<FileId, const Index *> cache;
+    struct stat                 st;
+
+    if (fstat(fileno(fp), &st) != 0 || !S_ISREG(st.st_mode)) {
+        return NULL;
+    }
+    FileId id = { st.st_dev, st.st_ino, st.st_size,
+                  st.st_mtim.tv_sec, st.st_mtim.tv_nsec };
+
+    std::lock_guard<std::mutex> guard(cacheLock);
+    std::map<FileId, const Index *>::iterator it = cache.find(id);
+    if (it != cache.end()) {
+        return it->second;
+    }
+    /* a failed parse is cached too, so such files are scanned right away */
+    const Index *idx = Parse(fp);
+    cache[id] = idx;
+    return idx;
+}
+
+
 /*! Finds the nth tag in section.
 
    @param tag Entry in the ini file to find.
@@ -191,6 +384,63 @@ IniFile::Find(double *result, StrDoublePair *pPair,
    @return pointer to the the variable after the '=' delimiter */
 const char *
 IniFile::Find(const char *_tag, const char *_section, int _num, int *lineno)
+{
+    // For exceptions.
+    lineNo = 0;
+    tag = _tag;
+    section = _section;
+    num = _num;
+
+    /* check valid file */
+    if(!CheckIfOpen())
+        return(NULL);
+
+    if (index == NULL) {
+        index = Index::Get(fp);
+    }
+    if (index == NULL || _tag[0] == 0 ||
+        strpbrk(_tag, " \t\r\n=") != NULL ||
+        (_section != NULL && strchr(_section, ']') != NULL)) {
+        return ScanFind(_tag, _section, _num, lineno);
+    }
+
+    const Index::TagMap *tags = &index->tags;
+    unsigned int endLineNo = index->totalLines;
+    if (_section != NULL) {
+        std::map<std::string, Index::Section>::const_iterator si =
+            index->sections.find(_section);
+        if (si == index->sections.end()) {
+            lineNo = index->totalLines;
+            ThrowException(ERR_SECTION_NOT_FOUND);
+            return(NULL);
+        }
+        tags = &si->second.tags;
+        endLineNo = si->second.endLineNo;
+    }
+
+    Index::TagMap::const_iterator ti = tags->find(_tag);
+    size_t n = _num > 1 ? _num - 1 : 0;
+    if (ti == tags->end() || n >= ti->second.size()) {
+        lineNo = endLineNo;
+        ThrowException(ERR_TAG_NOT_FOUND);
+        return(NULL);
+    }
+
+    const Index::Entry &e = index->entries[ti->second[n]];
+    lineNo = e.lineNo;
+    if (!e.hasValue) {
+        ThrowException(ERR_TAG_NOT_FOUND);
+        return(NULL);
+    }
+    if (lineno)
+        *lineno = lineNo;
+    return(e.value.c_str());
+}
+
+/*! Finds the nth tag in section by reading the file line by line; used
+   for the files and lookups the index does not cover. */
+const char *
+IniFile::ScanFind(const char *_tag, const char *_section, int _num, int *lineno)
 {
     // WTF, return a pointer to the middle of a local buffer?
     // FIX: this is totally non-reentrant.
@@ -208,16 +458,6 @@ IniFile::Find(const char *_tag, const char *_section, int _num, int *lineno)
     char* elinenext = eline;
     int   extend_ct = 0;
 
-    // For exceptions.
-    lineNo = 0;
-    tag = _tag;
-    section = _section;
-    num = _num;
-
-    /* check valid file */
-    if(!CheckIfOpen())
-        return(NULL);
-
     /* start from beginning */
     rewind(fp);
 
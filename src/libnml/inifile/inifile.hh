@@ -144,7 +144,10 @@ protected:
 
 
 private:
+    struct Index;
+
     FILE                        *fp;
+    const Index                 *index;
     struct flock                lock;
     bool                        owned;
 
@@ -156,11 +159,13 @@ private:
     const char *                section;
     int                         num;
 
+    const char *                ScanFind(const char *tag, const char *section,
+                                         int num, int *lineno);
     bool                        CheckIfOpen(void);
     bool                        LockFile(void);
     void                        ThrowException(ErrorCode);
-    char                        *AfterEqual(const char *string);
-    char                        *SkipWhite(const char *string);
+    static char                 *AfterEqual(const char *string);
+    static char                 *SkipWhite(const char *string);
 };
 #endif
 
@@ -0,0 +1,39 @@
+#!/bin/bash
+# Scan time of classicladder on the example projects: runs each
+# projects_examples/*.clp alone in a 1 ms thread and reports the mean and
+# max of the thread's .time pin.  Not run by runtests; use it to compare
+# two builds.
+#
+#     usage: scan-time.sh [samples] [project.clp ...]
+set -e
+
+SAMPLES=${1:-2000}
+shift || true
+if [ $# -eq 0 ]; then
+    set -- "${EMC2_HOME}"/src/hal/classicladder/projects_examples/*.clp
+fi
+
+scan() {
+    local clp=$1 hal=$(mktemp --suffix=.hal)
+    cat > $hal <<EOF2
+loadrt threads name1=plc period1=1000000 name2=mon period2=1000000
+loadrt classicladder_rt numRungs=100 numBits=500 numWords=100 numArithmExpr=100
+loadrt sampler depth=$SAMPLES cfg=s
+addf classicladder.0.refresh plc
+net t plc.time => sampler.0.pin.0
+addf sampler.0 mon
+loadusr -w classicladder --nogui $clp
+start
+loadusr -w sleep 0.5
+loadusr -w halsampler -n $SAMPLES
+EOF2
+    halrun -s -f $hal | awk -v clp=$(basename $clp) '
+        NF == 1 { sum += $1; n++; if ($1 > max) max = $1 }
+        END { printf "%-36s mean %8.0f  max %8d\n", clp, sum / n, max }'
+    rm -f $hal
+}
+
+echo "classicladder.0.refresh thread time (units of the thread's .time pin)"
+for clp in "$@"; do
+    scan $clp
+done
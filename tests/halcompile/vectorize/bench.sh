@@ -0,0 +1,43 @@
+#!/bin/bash
+# Compare the runtime of a thread running 1, 16 and 256 instances of the
+# lowpass test component, once built with 'option vectorize' and once
+# with one funct per instance.  Not run by runtests; run test.sh first
+# so that both components are installed.
+#
+#     usage: bench.sh [samples]
+set -e
+
+SAMPLES=${1:-2000}
+
+run() {
+    local kind=$1 count=$2 i hal=$(mktemp --suffix=.hal)
+    {
+        echo "loadrt threads name1=fast period1=1000000 name2=mon period2=1000000"
+        echo "loadrt ${kind}_lowpass count=$count"
+        echo "loadrt sampler depth=$SAMPLES cfg=s"
+        if [ $kind = vec ]; then
+            echo "addf vec-lowpass fast"
+        else
+            for ((i = 0; i < count; i++)); do
+                echo "addf scalar-lowpass.$i fast"
+            done
+        fi
+        echo "setp ${kind}-lowpass.0.enable 1"
+        echo "net t fast.time => sampler.0.pin.0"
+        echo "addf sampler.0 mon"
+        echo "start"
+        echo "loadusr -w halsampler -n $SAMPLES"
+        echo "getp fast.tmax"
+    } > $hal
+    halrun -s -f $hal | awk -v kind=$kind -v count=$count -v samples=$SAMPLES '
+        NF == 1 && NR <= samples { sum += $1; n++; next }
+        NF == 1 { tmax = $1 }
+        END { printf "%-7s %4d instances: mean %8.0f  max %8d\n", kind, count, sum / n, tmax }'
+    rm -f $hal
+}
+
+echo "thread runtime (fast.time, same units as the thread's .time pin)"
+for count in 1 16 256; do
+    run scalar $count
+    run vec $count
+done
@@ -0,0 +1,7 @@
+#!/bin/bash
+set -e
+
+${SUDO} halcompile --install vec_lowpass.comp
+${SUDO} halcompile --install scalar_lowpass.comp
+
+halrun -f vectorize.hal
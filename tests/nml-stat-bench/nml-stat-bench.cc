@@ -0,0 +1,160 @@
+// nml-stat-bench: cost of writing and reading EMC_STAT through NML
+//
+// Runs the same write-then-read loop over an emcStatus buffer set up four
+// ways and prints the mean time per write and per read:
+//
+//   raw         local SHMEM, not neutral: the struct is copied (what
+//               linuxcnc.nml uses for local processes)
+//   xdr         local SHMEM, neutral: every write encodes, every read
+//               decodes
+//   tcp-xdr     remote over TCP, XDR on the wire (the default for remote
+//               processes)
+//   tcp-raw     remote over TCP with force_raw: the struct goes over the
+//               wire as is, once both ends have checked they share a layout
+//
+// The remote modes use confirm_write so each write is a full round trip,
+// like each read.
+//
+//     usage: nml-stat-bench [iterations]
+
+#include "emc.hh"
+#include "emc_nml.hh"
+#include "cms.hh"
+#include "nml_srv.hh"
+#include "rcs_print.hh"
+#include "timer.hh"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+struct bench_mode {
+    const char *name;
+    int neutral;
+    int remote;
+    const char *options;
+};
+
+static const bench_mode modes[] = {
+    {"raw", 0, 0, ""},
+    {"xdr", 1, 0, ""},
+    {"tcp-xdr", 0, 1, "confirm_write"},
+    {"tcp-raw", 0, 1, "confirm_write force_raw"},
+};
+
+static void write_config(const char *path, const bench_mode *m, int key,
+    int port)
+{
+    FILE *f = fopen(path, "w");
+    if (!f) {
+	perror(path);
+	exit(1);
+    }
+    fprintf(f, "B emcStatus SHMEM localhost 20480 %d 0 1 16 %d TCP=%d xdr %s\n",
+	m->neutral, key, port, m->options);
+    if (m->remote) {
+	fprintf(f, "P svr emcStatus LOCAL localhost RW 1 1.0 1 0\n");
+	fprintf(f, "P writer emcStatus REMOTE localhost RW 0 5.0 0 1\n");
+	fprintf(f, "P reader emcStatus REMOTE localhost R 0 5.0 0 2\n");
+    } else {
+	fprintf(f, "P writer emcStatus LOCAL localhost RW 0 1.0 1 0\n");
+	fprintf(f, "P reader emcStatus LOCAL localhost R 0 1.0 0 1\n");
+    }
+    fclose(f);
+}
+
+/* Times one mode in its own process, so that the NML server list and the
+   shared memory of one mode do not leak into the next. */
+static int run_mode(const bench_mode *m, const char *path, int iterations,
+    int key, int port)
+{
+    write_config(path, m, key, port);
+
+    pid_t server = -1;
+    if (m->remote) {
+	server = fork();
+	if (server == 0) {
+	    new RCS_STAT_CHANNEL(emcFormat, "emcStatus", "svr", path);
+	    run_nml_servers();
+	    _exit(0);
+	}
+	esleep(0.5);
+    }
+    RCS_STAT_CHANNEL *writer =
+	new RCS_STAT_CHANNEL(emcFormat, "emcStatus", "writer", path);
+    RCS_STAT_CHANNEL *reader =
+	new RCS_STAT_CHANNEL(emcFormat, "emcStatus", "reader", path);
+    if (!writer->valid() || !reader->valid()) {
+	fprintf(stderr, "%s: can not open emcStatus\n", m->name);
+	if (server > 0) {
+	    kill(server, SIGINT);
+	}
+	return 1;
+    }
+
+    EMC_STAT *stat = new EMC_STAT;
+    double write_time = 0.0, read_time = 0.0;
+    int bad = 0;
+    for (int n = 0; n < iterations; n++) {
+	stat->motion.traj.position.tran.x = n;
+	stat->task.readLine = n;
+	double t0 = etime();
+	writer->write(stat);
+	double t1 = etime();
+	if (reader->read() != EMC_STAT_TYPE ||
+	    ((EMC_STAT *) reader->get_address())->task.readLine != n) {
+	    bad++;
+	}
+	double t2 = etime();
+	write_time += t1 - t0;
+	read_time += t2 - t1;
+    }
+    printf("%-8s %12.2f %12.2f %10ld%s\n", m->name,
+	write_time / iterations * 1e6, read_time / iterations * 1e6,
+	(long) writer->cms->header.in_buffer_size,
+	bad ? "  (stale or failed reads)" : "");
+    fflush(stdout);
+
+    delete stat;
+    delete reader;
+    delete writer;
+    if (server > 0) {
+	kill(server, SIGINT);
+	waitpid(server, NULL, 0);
+    }
+    return bad != 0;
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 20000;
+    char path[] = "/tmp/nml-stat-benchXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+	perror("mkstemp");
+	return 1;
+    }
+    close(fd);
+
+    set_rcs_print_destination(RCS_PRINT_TO_NULL);
+    printf("%-8s %12s %12s %10s\n", "mode", "write us", "read us", "bytes");
+    int failed = 0;
+    for (unsigned i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+	fflush(stdout);
+	pid_t child = fork();
+	if (child == 0) {
+	    _exit(run_mode(&modes[i], path, iterations,
+		    7300 + getppid() % 1000 + i, 20000 + getppid() % 10000 + i));
+	}
+	int status = 1;
+	waitpid(child, &status, 0);
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+	    failed = 1;
+	}
+    }
+    unlink(path);
+    return failed;
+}
@@ -0,0 +1,19 @@
+#!/bin/bash
+# Benchmark for EMC_STAT over NML: builds nml-stat-bench against an installed
+# or run-in-place tree and runs it.  Not run by runtests; use it to compare
+# two builds.
+#
+#     usage: nml-stat-bench.sh [iterations]
+set -e
+
+DIR=$(cd "$(dirname "$0")" && pwd)
+TOP=$(cd "$DIR"/../.. && pwd)
+HEADERS=${HEADERS:-$TOP/include}
+LIBDIR=${LIBDIR:-$TOP/lib}
+
+BIN=$(mktemp)
+trap 'rm -f $BIN' EXIT
+g++ -O2 -Wall -DULAPI -I"$HEADERS" -o $BIN "$DIR"/nml-stat-bench.cc \
+    -L"$LIBDIR" -Wl,-rpath,"$LIBDIR" -lnml -llinuxcnc -ltooldata -lposemath
+
+$BIN "$@"
@@ -0,0 +1,327 @@
+/*
+ * nml-tcp-load: simulate many remote NML clients of one TCP server
+ *
+ * Speaks the raw CMS TCP protocol (see src/libnml/buffer/tcpmem.cc) so it
+ * needs no message definitions.  All clients share one process and one
+ * poll() loop; each has its own connection.
+ *
+ *     usage: nml-tcp-load [-h host] [-p port] [-b buffer] [-n clients]
+ *                         [-m read|blocking|subscribe] [-i millis]
+ *                         [-t seconds]
+ *
+ * Defaults are the emcStatus buffer of configs/common/linuxcnc.nml.
+ * "read" sends a read request every -i milliseconds, "blocking" keeps one
+ * blocking read outstanding, "subscribe" asks for a polled subscription
+ * with -i milliseconds between updates.  At the end it prints replies and
+ * new messages per second and the request-to-reply latency.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/* from src/libnml/buffer/rem_msg.hh and src/libnml/cms/cms.hh */
+#define REMOTE_CMS_READ_REQUEST_TYPE 1
+#define REMOTE_CMS_SET_SUBSCRIPTION_REQUEST_TYPE 9
+#define REMOTE_CMS_BLOCKING_READ_REQUEST_TYPE 11
+#define CMS_POLLED_SUBSCRIPTION 1
+#define CMS_READ_ACCESS 1
+#define CMS_READ_OK 2
+#define CMS_TIMED_OUT -6
+
+enum mode { MODE_READ, MODE_BLOCKING, MODE_SUBSCRIBE };
+
+struct client {
+    int fd;
+    uint32_t serial;
+    uint32_t last_id;
+    int pending;		/* request sent, reply not complete */
+    int want;			/* bytes still needed for this frame */
+    int have;
+    int header_done;
+    int setup_done;		/* subscription acknowledged */
+    double sent_at;
+    double next_at;
+    unsigned char buf[20];
+};
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void put32(unsigned char *p, uint32_t v)
+{
+    v = htonl(v);
+    memcpy(p, &v, 4);
+}
+
+static uint32_t get32(const unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return ntohl(v);
+}
+
+static int sendall(int fd, const unsigned char *p, int n)
+{
+    while (n > 0) {
+	int r = send(fd, p, n, MSG_NOSIGNAL);
+	if (r < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return -1;
+	}
+	p += r;
+	n -= r;
+    }
+    return 0;
+}
+
+static int connect_to(const char *host, int port)
+{
+    struct addrinfo hints, *res;
+    char portstr[16];
+    int fd, one = 1;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(portstr, sizeof(portstr), "%d", port);
+    if (getaddrinfo(host, portstr, &hints, &res) != 0)
+	return -1;
+    fd = socket(res->ai_family, res->ai_socktype, 0);
+    if (fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen) < 0) {
+	close(fd);
+	fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd >= 0)
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+static int send_request(struct client *c, enum mode mode, int buffer,
+    int interval_millis)
+{
+    unsigned char req[24];
+    int n = 20;
+
+    put32(req, c->serial);
+    put32(req + 8, buffer);
+    switch (mode) {
+    case MODE_READ:
+	put32(req + 4, REMOTE_CMS_READ_REQUEST_TYPE);
+	put32(req + 12, CMS_READ_ACCESS);
+	put32(req + 16, c->last_id);
+	break;
+    case MODE_BLOCKING:
+	put32(req + 4, REMOTE_CMS_BLOCKING_READ_REQUEST_TYPE);
+	put32(req + 12, CMS_READ_ACCESS);
+	put32(req + 16, c->last_id);
+	put32(req + 20, 1000);	/* timeout_millis */
+	n = 24;
+	break;
+    case MODE_SUBSCRIBE:
+	put32(req + 4, REMOTE_CMS_SET_SUBSCRIPTION_REQUEST_TYPE);
+	put32(req + 12, CMS_POLLED_SUBSCRIPTION);
+	put32(req + 16, interval_millis);
+	break;
+    }
+    c->serial++;
+    c->pending = 1;
+    c->header_done = 0;
+    c->have = 0;
+    /* the subscription reply is serial and success only */
+    c->want = (mode == MODE_SUBSCRIBE && !c->setup_done) ? 8 : 20;
+    c->sent_at = now();
+    return sendall(c->fd, req, n);
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+	"usage: nml-tcp-load [-h host] [-p port] [-b buffer] [-n clients]\n"
+	"                    [-m read|blocking|subscribe] [-i millis]"
+	" [-t seconds]\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    const char *host = "localhost";
+    int port = 5005, buffer = 2, nclients = 20, interval_millis = 100;
+    double seconds = 10.0;
+    enum mode mode = MODE_READ;
+    struct client *clients;
+    struct pollfd *pfds;
+    unsigned char scratch[4096];
+    long replies = 0, updates = 0, errors = 0;
+    double lat_sum = 0, lat_max = 0, start, end;
+    int opt, i;
+
+    while ((opt = getopt(argc, argv, "h:p:b:n:m:i:t:")) != -1) {
+	switch (opt) {
+	case 'h': host = optarg; break;
+	case 'p': port = atoi(optarg); break;
+	case 'b': buffer = atoi(optarg); break;
+	case 'n': nclients = atoi(optarg); break;
+	case 'i': interval_millis = atoi(optarg); break;
+	case 't': seconds = atof(optarg); break;
+	case 'm':
+	    if (!strcmp(optarg, "read"))
+		mode = MODE_READ;
+	    else if (!strcmp(optarg, "blocking"))
+		mode = MODE_BLOCKING;
+	    else if (!strcmp(optarg, "subscribe"))
+		mode = MODE_SUBSCRIBE;
+	    else
+		usage();
+	    break;
+	default:
+	    usage();
+	}
+    }
+    if (nclients < 1)
+	usage();
+
+    clients = calloc(nclients, sizeof(*clients));
+    pfds = calloc(nclients, sizeof(*pfds));
+    if (!clients || !pfds) {
+	perror("calloc");
+	return 1;
+    }
+    for (i = 0; i < nclients; i++) {
+	clients[i].fd = connect_to(host, port);
+	if (clients[i].fd < 0) {
+	    fprintf(stderr, "client %d: can not connect to %s:%d: %s\n", i,
+		host, port, strerror(errno));
+	    return 1;
+	}
+	pfds[i].fd = clients[i].fd;
+	pfds[i].events = POLLIN;
+	if (send_request(&clients[i], mode, buffer, interval_millis) < 0) {
+	    perror("send");
+	    return 1;
+	}
+    }
+
+    start = now();
+    end = start + seconds;
+    while (now() < end) {
+	double t = now();
+	int timeout = (int) ((end - t) * 1000.0) + 1;
+	if (mode == MODE_READ) {
+	    for (i = 0; i < nclients; i++) {
+		struct client *c = &clients[i];
+		if (!c->pending && c->next_at <= t) {
+		    if (send_request(c, mode, buffer, interval_millis) < 0)
+			errors++;
+		    c->next_at = c->sent_at + interval_millis / 1000.0;
+		}
+		if (!c->pending) {
+		    int w = (int) ((c->next_at - t) * 1000.0) + 1;
+		    if (w < timeout)
+			timeout = w;
+		}
+	    }
+	}
+	if (poll(pfds, nclients, timeout) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    perror("poll");
+	    return 1;
+	}
+	for (i = 0; i < nclients; i++) {
+	    struct client *c = &clients[i];
+	    int r;
+	    if (!(pfds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+		continue;
+	    if (!c->header_done)
+		r = recv(c->fd, c->buf + c->have, c->want - c->have, 0);
+	    else
+		r = recv(c->fd, scratch,
+		    c->want - c->have < (int) sizeof(scratch) ?
+		    c->want - c->have : (int) sizeof(scratch), 0);
+	    if (r <= 0) {
+		fprintf(stderr, "client %d: connection closed\n", i);
+		return 1;
+	    }
+	    c->have += r;
+	    if (c->have < c->want)
+		continue;
+	    if (!c->header_done && c->want == 8) {
+		/* subscription acknowledged, updates follow */
+		if (!get32(c->buf + 4))
+		    errors++;
+		c->setup_done = 1;
+		c->header_done = 0;
+		c->have = 0;
+		c->want = 20;
+		c->sent_at = now();
+		continue;
+	    }
+	    if (!c->header_done) {
+		int size = (int) get32(c->buf + 8);
+		int status = (int) get32(c->buf + 4);
+		if (status < 0 && status != CMS_TIMED_OUT)
+		    errors++;
+		if (status == CMS_READ_OK && get32(c->buf + 12) != c->last_id) {
+		    c->last_id = get32(c->buf + 12);
+		    updates++;
+		}
+		if (size > 0) {
+		    c->header_done = 1;
+		    c->have = 0;
+		    c->want = size;
+		    continue;
+		}
+	    }
+	    /* frame complete */
+	    t = now() - c->sent_at;
+	    lat_sum += t;
+	    if (t > lat_max)
+		lat_max = t;
+	    replies++;
+	    c->pending = 0;
+	    c->header_done = 0;
+	    c->have = 0;
+	    c->want = 20;
+	    if (mode == MODE_BLOCKING) {
+		if (send_request(c, mode, buffer, interval_millis) < 0)
+		    errors++;
+	    } else if (mode == MODE_SUBSCRIBE) {
+		c->pending = 1;
+		c->sent_at = now();
+	    }
+	}
+    }
+    seconds = now() - start;
+
+    printf("%d clients, mode %s, %.1f s\n", nclients,
+	mode == MODE_READ ? "read" :
+	mode == MODE_BLOCKING ? "blocking" : "subscribe", seconds);
+    printf("replies/s %10.1f  new messages/s %10.1f  errors %ld\n",
+	replies / seconds, updates / seconds, errors);
+    if (replies)
+	printf("%s mean %8.3f ms  max %8.3f ms\n",
+	    mode == MODE_SUBSCRIBE ? "update interval" : "latency",
+	    lat_sum / replies * 1000.0, lat_max * 1000.0);
+    for (i = 0; i < nclients; i++)
+	close(clients[i].fd);
+    free(clients);
+    free(pfds);
+    return errors != 0;
+}
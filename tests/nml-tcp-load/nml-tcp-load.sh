@@ -0,0 +1,20 @@
+#!/bin/bash
+# Load test for the NML TCP server: builds nml-tcp-load and runs it in each
+# mode against a running linuxcncsvr (emcStatus on port 5005 by default).
+# Not run by runtests; use it to compare two builds.
+#
+#     usage: nml-tcp-load.sh [clients] [nml-tcp-load options ...]
+set -e
+
+CLIENTS=${1:-50}
+shift || true
+
+DIR=$(cd "$(dirname "$0")" && pwd)
+BIN=$(mktemp)
+trap 'rm -f $BIN' EXIT
+gcc -O2 -Wall -o $BIN "$DIR"/nml-tcp-load.c
+
+for mode in read blocking subscribe; do
+    $BIN -n $CLIENTS -m $mode "$@"
+    echo
+done